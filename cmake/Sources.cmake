@@ -2,6 +2,10 @@ set(H_SOURCES_ROOT ${CMAKE_CURRENT_SOURCE_DIR}/sources)
 set(H_TARGETS
         hyengine
         hyengine-demo
+        hyengine-log-decoder
+        hyengine-asset-packer
+        hyengine-queue-stress
+        hyengine-benchmark
         pcg
         stblib
         miniaudio
@@ -9,6 +13,10 @@ set(H_TARGETS
 
 add_subdirectory(sources/hyengine)
 add_subdirectory(sources/hyengine-demo)
+add_subdirectory(sources/hyengine-log-decoder)
+add_subdirectory(sources/hyengine-asset-packer)
+add_subdirectory(sources/hyengine-queue-stress)
+add_subdirectory(sources/hyengine-benchmark)
 add_subdirectory(sources/stblib)
 add_subdirectory(sources/pcg)
 add_subdirectory(sources/miniaudio)
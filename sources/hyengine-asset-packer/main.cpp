@@ -0,0 +1,61 @@
+#include <iostream>
+
+#include "hyengine/core/asset_archive.hpp"
+#include "hyengine/core/file_io.hpp"
+#include "hyengine/core/logger.hpp"
+
+///Packs every asset in a directory into an archive for hyengine::mount_asset_archive.
+///Asset IDs are taken from the path relative to the directory, e.g. 'hyengine/font/image/Buycat.png' packs as 'hyengine.font.image.Buycat'.
+///Files whose extension doesn't match their type folder can't be loaded by ID, so are skipped.
+///Usage: hyengine-asset-packer <asset directory> <output archive>
+int main(const int argc, char** argv)
+{
+    if (argc != 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " <asset directory> <output archive>\n";
+        return 1;
+    }
+
+    const std::filesystem::path directory = argv[1];
+    if (!std::filesystem::is_directory(directory))
+    {
+        std::cerr << "'" << directory.string() << "' isn't a directory\n";
+        return 1;
+    }
+
+    std::vector<hyengine::asset_archive_input> inputs;
+    for (const std::filesystem::directory_entry& entry : std::filesystem::recursive_directory_iterator(directory))
+    {
+        if (!entry.is_regular_file()) continue;
+
+        const std::filesystem::path relative_path = std::filesystem::relative(entry.path(), directory);
+        const std::string type = relative_path.parent_path().filename().string();
+        const std::string extension = relative_path.extension().string();
+        if (type.empty() || extension.size() < 2 || extension.substr(1) != hyengine::get_asset_extension(type))
+        {
+            std::cerr << "Skipping '" << relative_path.string() << "' - not loadable as an asset\n";
+            continue;
+        }
+
+        std::string id;
+        const std::filesystem::path id_path = std::filesystem::path(relative_path).replace_extension();
+        for (const std::filesystem::path& part : id_path)
+        {
+            if (!id.empty()) id += '.';
+            id += part.string();
+        }
+        inputs.push_back({std::move(id), entry.path()});
+    }
+
+    const size_t asset_count = inputs.size();
+    if (!hyengine::write_asset_archive(argv[2], std::move(inputs)))
+    {
+        //The cause was logged, and there's no threadpool to flush it in the background
+        hyengine::flush_logs_now();
+        std::cerr << "Failed to write '" << argv[2] << "'\n";
+        return 1;
+    }
+
+    std::cout << "Packed " << asset_count << " assets into '" << argv[2] << "'\n";
+    return 0;
+}
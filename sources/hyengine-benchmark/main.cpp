@@ -0,0 +1,292 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hyengine/core/file_io.hpp"
+#include "hyengine/core/file_log_sink.hpp"
+#include "hyengine/core/logger.hpp"
+#include "hyengine/threading/threading.hpp"
+
+using hyengine::u64;
+using hyengine::u32;
+using hyengine::f64;
+
+using benchmark_clock = std::chrono::steady_clock;
+
+static constexpr u64 SCALING_ITEMS = 1 << 20;
+static constexpr u32 SCALING_RUNS = 5;
+static constexpr u32 LATENCY_SAMPLES = 1000;
+static constexpr u64 DISABLED_LOG_CALLS = 10000000;
+static constexpr u64 SINK_BATCHES = 200;
+static constexpr u64 SINK_BATCH_SIZE = 1000;
+static constexpr u32 LOAD_RUNS = 3;
+
+///Written by every iteration of the disabled log loops, so the compiler can't drop the loops altogether
+static volatile u64 loop_counter = 0;
+
+static f64 seconds_since(const benchmark_clock::time_point start)
+{
+    return std::chrono::duration<f64>(benchmark_clock::now() - start).count();
+}
+
+static void print_result(const std::string& name, const f64 value, const std::string& unit)
+{
+    std::cout << std::left << std::setw(44) << name << std::right << std::fixed << std::setprecision(2) << std::setw(12) << value << ' ' << unit << '\n';
+}
+
+///Some arithmetic per index, heavy enough that scheduling overhead doesn't dominate
+static u64 scaling_work(const u64 index)
+{
+    u64 value = index;
+    for (u32 i = 0; i < 64; i++) value = value * 6364136223846793005ULL + 1442695040888963407ULL;
+    return value;
+}
+
+///Times a fixed parallel_for over 1 worker, then powers of two up to one per logical core
+static void benchmark_worker_scaling()
+{
+    std::cout << "Worker scaling (parallel_for over " << SCALING_ITEMS << " items, best of " << SCALING_RUNS << ")\n";
+    const u32 max_workers = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<u32> worker_counts;
+    for (u32 workers = 1; workers < max_workers; workers *= 2) worker_counts.push_back(workers);
+    worker_counts.push_back(max_workers);
+
+    std::vector<u64> results(SCALING_ITEMS);
+    f64 single_worker_time = 0;
+    for (const u32 workers : worker_counts)
+    {
+        hyengine::create_threadpool({.worker_count = workers});
+        f64 best = 1e9;
+        for (u32 run = 0; run < SCALING_RUNS; run++)
+        {
+            const benchmark_clock::time_point start = benchmark_clock::now();
+            hyengine::parallel_for(0, SCALING_ITEMS, 0, [&](const u64 index) { results[index] = scaling_work(index); });
+            best = std::min(best, seconds_since(start));
+        }
+        hyengine::release_threadpool();
+
+        if (workers == 1) single_worker_time = best;
+        std::cout << std::left << std::setw(44) << "  " + std::to_string(workers) + " workers" << std::right << std::fixed << std::setprecision(2)
+            << std::setw(12) << best * 1e3 << " ms   x" << single_worker_time / best << '\n';
+    }
+}
+
+struct idle_policy
+{
+    std::string name;
+    u32 spin_count;
+    u32 yield_count;
+};
+
+///Measures enqueue-to-start latency with each idle policy, for tasks enqueued back to back, shortly after the last, and after the pool has gone to sleep
+static void benchmark_idle_latency()
+{
+    std::cout << "\nEnqueue to start latency (" << LATENCY_SAMPLES << " tasks, 2 workers, p50 / p99)\n";
+    const std::vector<idle_policy> policies = {{"spin", 256, 16}, {"yield", 0, 16}, {"sleep", 0, 0}};
+    const std::vector<u32> gaps_us = {0, 20, 1000};
+
+    for (const idle_policy& policy : policies)
+    {
+        hyengine::create_threadpool({.worker_count = 2, .idle_spin_count = policy.spin_count, .idle_yield_count = policy.yield_count, .log_flush_interval = 0});
+        for (const u32 gap_us : gaps_us)
+        {
+            std::vector<f64> latencies;
+            latencies.reserve(LATENCY_SAMPLES);
+            for (u32 sample = 0; sample < LATENCY_SAMPLES; sample++)
+            {
+                //Busy wait short gaps, as sleeping that briefly overshoots by far more than the gap
+                const benchmark_clock::time_point gap_start = benchmark_clock::now();
+                if (gap_us >= 1000) std::this_thread::sleep_for(std::chrono::microseconds(gap_us));
+                else while (seconds_since(gap_start) * 1e6 < gap_us) {}
+
+                std::atomic<bool> started = false;
+                benchmark_clock::time_point start_time;
+                hyengine::function_task task([&] { start_time = benchmark_clock::now(); started.store(true, std::memory_order_release); });
+                const benchmark_clock::time_point enqueue_time = benchmark_clock::now();
+                task.enqueue();
+
+                //Don't await straight away, or this thread would run the task itself
+                while (!started.load(std::memory_order_acquire)) std::this_thread::yield();
+                task.await_completed();
+                latencies.push_back(std::chrono::duration<f64>(start_time - enqueue_time).count());
+            }
+
+            std::sort(latencies.begin(), latencies.end());
+            const f64 p50 = latencies[latencies.size() / 2] * 1e6;
+            const f64 p99 = latencies[latencies.size() * 99 / 100] * 1e6;
+            std::cout << std::left << std::setw(44) << "  " + policy.name + ", " + std::to_string(gap_us) + " us between tasks" << std::right << std::fixed
+                << std::setprecision(2) << std::setw(12) << p50 << " / " << p99 << " us\n";
+        }
+        hyengine::release_threadpool();
+    }
+}
+
+///Runs body DISABLED_LOG_CALLS times, returning the nanoseconds per call
+static f64 nanoseconds_per_call(const auto& body)
+{
+    const benchmark_clock::time_point start = benchmark_clock::now();
+    for (u64 i = 0; i < DISABLED_LOG_CALLS; i++) body(i);
+    return seconds_since(start) / DISABLED_LOG_CALLS * 1e9;
+}
+
+///Cost of log calls that don't log, against an empty loop: one filtered out by the runtime log level, which should return before touching its arguments,
+///and ones compiled out by HYENGINE_COMPILED_LOG_LEVEL or HYENGINE_STRIPPED_LOG_TAGS, which should cost nothing over the empty loop
+static void benchmark_disabled_log()
+{
+    std::cout << "\nDisabled log calls (" << DISABLED_LOG_CALLS << " calls)\n";
+    const hyengine::log_level previous_level = hyengine::get_log_level();
+    hyengine::set_log_level(hyengine::log_level::REDUCED);
+    const std::string text = "value";
+
+    print_result("  empty loop", nanoseconds_per_call([](const u64 i) { loop_counter = i; }), "ns");
+
+    print_result("  log_info below the runtime log level", nanoseconds_per_call([&](const u64 i)
+    {
+        hyengine::log_info(hyengine::logger_tags::DEBUG, "Disabled ", text, " ", i, " of ", DISABLED_LOG_CALLS);
+        loop_counter = i;
+    }), "ns");
+
+    if constexpr (hyengine::COMPILED_LOG_LEVEL < hyengine::log_level::ALL)
+    {
+        print_result("  log_debug above the compiled log level", nanoseconds_per_call([&](const u64 i)
+        {
+            hyengine::log_debug(hyengine::logger_tags::DEBUG, "Stripped ", text, " ", i, " of ", DISABLED_LOG_CALLS);
+            loop_counter = i;
+        }), "ns");
+    }
+    else std::cout << "  log_debug is compiled in, build with HYENGINE_COMPILED_LOG_LEVEL=NORMAL to measure it stripped\n";
+
+    if constexpr (hyengine::logger_tags::STRIPPED_TAG_COUNT > 0)
+    {
+        using hyengine::logger_tags::STRIPPED_TAG_NAMES;
+        static constexpr hyengine::logger_tags::tag stripped_tag(STRIPPED_TAG_NAMES.substr(0, STRIPPED_TAG_NAMES.find(',')), "");
+        print_result("  log_error with a stripped tag", nanoseconds_per_call([&](const u64 i)
+        {
+            hyengine::log_error(stripped_tag, "Stripped ", text, " ", i, " of ", DISABLED_LOG_CALLS);
+            loop_counter = i;
+        }), "ns");
+    }
+    else std::cout << "  No tags are stripped, build with HYENGINE_STRIPPED_LOG_TAGS=Input to measure a stripped tag\n";
+
+    hyengine::set_log_level(previous_level);
+}
+
+static std::vector<hyengine::log_message> make_log_batch(const u64 batch)
+{
+    std::vector<hyengine::log_message> messages(SINK_BATCH_SIZE);
+    for (u64 i = 0; i < SINK_BATCH_SIZE; i++)
+    {
+        //Distinct text, so the console sink doesn't collapse them into a repeat count
+        messages[i] = {static_cast<u64>(i), 1, "Debug", "", "INFO", "", "Benchmark message " + std::to_string(batch * SINK_BATCH_SIZE + i) + " with some typical payload text"};
+    }
+    return messages;
+}
+
+///Throughput of the async file sink against the console sink writing through std::cout, with cout redirected to a file so the terminal isn't the bottleneck
+static void benchmark_log_sinks(const std::filesystem::path& directory)
+{
+    const u64 total = SINK_BATCHES * SINK_BATCH_SIZE;
+    std::cout << "\nLog sink throughput (" << total << " messages)\n";
+    std::vector<std::vector<hyengine::log_message>> batches;
+    for (u64 batch = 0; batch < SINK_BATCHES; batch++) batches.push_back(make_log_batch(batch));
+
+    hyengine::create_threadpool({.log_flush_interval = 0});
+    u64 dropped = 0;
+    benchmark_clock::time_point start = benchmark_clock::now();
+    {
+        hyengine::file_log_sink sink(directory / "file-sink.log", UINT64_MAX);
+        for (const std::vector<hyengine::log_message>& batch : batches) sink.write(batch);
+        dropped = sink.get_dropped_count();
+    }
+    const f64 file_time = seconds_since(start);
+    hyengine::release_threadpool();
+    print_result("  file_log_sink" + (dropped > 0 ? " (" + std::to_string(dropped) + " dropped)" : std::string()), total / file_time / 1e6, "M/s");
+
+    std::ofstream redirected(directory / "console-sink.log");
+    std::streambuf* const cout_buffer = std::cout.rdbuf(redirected.rdbuf());
+    start = benchmark_clock::now();
+    for (const std::vector<hyengine::log_message>& batch : batches) hyengine::get_console_log_sink()->write(batch);
+    std::cout.flush();
+    const f64 console_time = seconds_since(start);
+    std::cout.rdbuf(cout_buffer);
+    print_result("  console sink via std::cout", total / console_time / 1e6, "M/s");
+}
+
+///Loads one large asset through a plain ifstream read, load_asset_bytes and view_asset (touching every page). The file was just written, so it's in the page cache.
+static void benchmark_large_load(const std::filesystem::path& directory, const u64 size_mb)
+{
+    std::cout << "\nLarge file load (" << size_mb << " MB, warm cache, best of " << LOAD_RUNS << ")\n";
+    hyengine::set_primary_asset_directory(directory.string());
+    const std::filesystem::path path = directory / "benchmark" / "bin" / "large.bin";
+    std::filesystem::create_directories(path.parent_path());
+    {
+        std::vector<char> chunk(1024 * 1024);
+        for (u64 i = 0; i < chunk.size(); i++) chunk[i] = static_cast<char>(i * 31);
+        std::ofstream file(path, std::ios::binary);
+        for (u64 i = 0; i < size_mb; i++) file.write(chunk.data(), static_cast<std::streamsize>(chunk.size()));
+    }
+
+    f64 stream_time = 1e9;
+    f64 bytes_time = 1e9;
+    f64 view_time = 1e9;
+    u64 checksum = 0;
+    for (u32 run = 0; run < LOAD_RUNS; run++)
+    {
+        benchmark_clock::time_point start = benchmark_clock::now();
+        {
+            std::ifstream file(path, std::ios::binary);
+            std::vector<char> bytes(std::filesystem::file_size(path));
+            file.read(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+            checksum += static_cast<u64>(bytes.back());
+        }
+        stream_time = std::min(stream_time, seconds_since(start));
+
+        start = benchmark_clock::now();
+        {
+            const std::vector<hyengine::u8> bytes = hyengine::load_asset_bytes("benchmark.bin.large");
+            checksum += bytes.back();
+        }
+        bytes_time = std::min(bytes_time, seconds_since(start));
+
+        start = benchmark_clock::now();
+        {
+            const hyengine::asset_view view = hyengine::view_asset("benchmark.bin.large");
+            for (u64 offset = 0; offset < view.size(); offset += 4096) checksum += view.data()[offset];
+        }
+        view_time = std::min(view_time, seconds_since(start));
+    }
+
+    print_result("  std::ifstream read", stream_time * 1e3, "ms");
+    print_result("  load_asset_bytes", bytes_time * 1e3, "ms");
+    print_result("  view_asset, touching every page", view_time * 1e3, "ms");
+    if (checksum == 0) std::cout << '\n'; //Keeps the reads from being optimized out
+}
+
+///Benchmarks the engine's hot paths: threadpool worker scaling, enqueue-to-start latency per idle policy, disabled log calls,
+///log sink throughput and large asset loads. Numbers are for comparing changes on the same machine, not absolute.
+///Usage: hyengine-benchmark [large file size in MB]
+int main(const int argc, char** argv)
+{
+    const u64 size_mb = argc > 1 ? std::stoull(argv[1]) : 256;
+    const std::filesystem::path directory = std::filesystem::temp_directory_path() / "hyengine-benchmark";
+    std::filesystem::create_directories(directory);
+
+    //Keep the pool's own info messages out of the results
+    hyengine::set_log_level(hyengine::log_level::REDUCED);
+
+    benchmark_worker_scaling();
+    benchmark_idle_latency();
+    benchmark_disabled_log();
+    benchmark_log_sinks(directory);
+    benchmark_large_load(directory, size_mb);
+
+    std::filesystem::remove_all(directory);
+    return 0;
+}
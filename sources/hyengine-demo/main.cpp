@@ -1,5 +1,6 @@
 #include <filesystem>
 
+#include "hyengine/core/asset_loader.hpp"
 #include "hyengine/core/hyengine.hpp"
 #include "hyengine/graphics/font/font_meta.hpp"
 #include "hyengine/common/colors.hpp"
@@ -84,10 +85,13 @@ int main()
 
     hyengine::set_override_asset_directory("assets-demo");
 
+    //Decode the font atlas on a worker while the glyph metadata loads
+    const hyengine::asset_future<hyengine::asset_image_data> font_image = hyengine::load_asset_image_async("hyengine.font.image.Buycat");
+
     hyengine::font_meta test_font_meta("hyengine.font.meta.Buycat");
     test_font_meta.load();
 
-    hyengine::asset_image_data texture_data = hyengine::load_asset_image("hyengine.font.image.Buycat");
+    hyengine::asset_image_data texture_data = font_image.get();
 
     hyengine::texture_buffer font_texture;
     const bool did_allocate = font_texture.allocate(GL_TEXTURE_2D, {texture_data.width, texture_data.height, 1}, 1, GL_RGBA8, 0);
@@ -0,0 +1,50 @@
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+
+#include "hyengine/core/binary_log.hpp"
+#include "hyengine/core/logger.hpp"
+
+///Renders binary logs written by hyengine::open_binary_log as text, one message per line.
+///Usage: hyengine-log-decoder <log file>...
+int main(const int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <log file>...\n";
+        return 1;
+    }
+
+    int result = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        hyengine::binary_log_reader reader;
+        if (!reader.open(argv[i]))
+        {
+            //Shows why it couldn't be opened, which was logged rather than returned
+            hyengine::flush_logs_now();
+            std::cerr << "'" << argv[i] << "' isn't a readable binary log\n";
+            result = 1;
+            continue;
+        }
+
+        hyengine::binary_log_entry entry;
+        while (reader.next(entry))
+        {
+            const std::time_t entry_time = static_cast<std::time_t>(entry.timestamp / 1000000000);
+            const hyengine::u64 milliseconds = entry.timestamp / 1000000 % 1000;
+
+            // ReSharper disable once CppDeprecatedEntity
+            const auto& time = std::localtime(&entry_time);
+
+            std::cout << std::setfill('0');
+            std::cout << '[' << std::setw(2) << time->tm_hour << ':' << std::setw(2) << time->tm_min << ':' << std::setw(2) << time->tm_sec << '.' << std::setw(3) << milliseconds << ']';
+            std::cout << "[T" << std::setw(3) << entry.thread_id << ']';
+            if (!entry.type.empty()) std::cout << '[' << entry.type << ']';
+            if (!entry.tag_id.empty()) std::cout << '[' << entry.tag_id << ']';
+            std::cout << ' ' << entry.message << '\n';
+        }
+    }
+
+    return result;
+}
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "hyengine/common/data/mpmc_queue.hpp"
+#include "hyengine/common/data/spsc_queue.hpp"
+
+using hyengine::u64;
+using hyengine::u32;
+using hyengine::f64;
+
+///Small enough that every run wraps the rings many thousands of times
+static constexpr u64 STRESS_CAPACITY = 64;
+static constexpr u64 BENCHMARK_CAPACITY = 1024;
+static constexpr u64 MAX_BATCH_SIZE = 16;
+static constexpr std::array<u64, 2> BATCH_SIZES = {1, MAX_BATCH_SIZE};
+
+///Values carry their producer in the top bits and a per-producer sequence number (from 1) in the rest
+static constexpr u64 PRODUCER_SHIFT = 48;
+
+///Mutex and deque with the queues' interface, as a baseline for the benchmarks
+template <typename type, u64 capacity>
+class locked_queue
+{
+public:
+    bool push(type value)
+    {
+        return push_batch(std::span(&value, 1)) == 1;
+    }
+
+    u64 push_batch(const std::span<const type> values)
+    {
+        lock.lock();
+        const u64 count = std::min<u64>(values.size(), capacity - elements.size());
+        elements.insert(elements.end(), values.begin(), values.begin() + static_cast<std::ptrdiff_t>(count));
+        lock.unlock();
+        return count;
+    }
+
+    bool pop(type& value_out)
+    {
+        return pop_batch(std::span(&value_out, 1)) == 1;
+    }
+
+    u64 pop_batch(const std::span<type> values_out)
+    {
+        lock.lock();
+        const u64 count = std::min<u64>(values_out.size(), elements.size());
+        std::copy_n(elements.begin(), count, values_out.begin());
+        elements.erase(elements.begin(), elements.begin() + static_cast<std::ptrdiff_t>(count));
+        lock.unlock();
+        return count;
+    }
+
+private:
+    std::mutex lock;
+    std::deque<type> elements;
+};
+
+///Pushes count values tagged with the producer index, alternating single pushes and batches of varying size when batch_size is above one.
+template <typename queue_type>
+void produce(queue_type& queue, const u64 producer, const u64 count, const u64 batch_size)
+{
+    u64 batch[MAX_BATCH_SIZE];
+    u64 sequence = 1;
+    u64 round = 0;
+    while (sequence <= count)
+    {
+        const u64 size = std::min(batch_size > 1 ? 1 + round++ % batch_size : 1, count - sequence + 1);
+        for (u64 i = 0; i < size; i++) batch[i] = producer << PRODUCER_SHIFT | (sequence + i);
+
+        const u64 pushed = size == 1 ? (queue.push(batch[0]) ? 1 : 0) : queue.push_batch(std::span<const u64>(batch, size));
+        if (pushed == 0) std::this_thread::yield();
+        sequence += pushed;
+    }
+}
+
+///Pops until total values have been taken across every consumer. Each consumer must see each producer's values in order.
+template <typename queue_type>
+bool consume(queue_type& queue, std::atomic<u64>& consumed, const u64 total, const u64 batch_size, std::vector<u64>& seen_out)
+{
+    std::vector<u64> last_sequence(seen_out.size(), 0);
+    u64 batch[MAX_BATCH_SIZE];
+    u64 round = 0;
+    bool in_order = true;
+    while (consumed.load(std::memory_order_relaxed) < total)
+    {
+        const u64 size = batch_size > 1 ? 1 + round++ % batch_size : 1;
+        const u64 popped = size == 1 ? (queue.pop(batch[0]) ? 1 : 0) : queue.pop_batch(std::span<u64>(batch, size));
+        if (popped == 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        for (u64 i = 0; i < popped; i++)
+        {
+            const u64 producer = batch[i] >> PRODUCER_SHIFT;
+            const u64 sequence = batch[i] & ((1ULL << PRODUCER_SHIFT) - 1);
+            if (sequence <= last_sequence[producer]) in_order = false;
+            last_sequence[producer] = sequence;
+            seen_out[producer]++;
+        }
+        consumed.fetch_add(popped, std::memory_order_relaxed);
+    }
+    return in_order;
+}
+
+struct run_result
+{
+    bool passed;
+    f64 seconds;
+};
+
+///Runs producers and consumers over one queue and checks every value arrived exactly once and in per-producer order
+template <typename queue_type>
+run_result run_queue(queue_type& queue, const u32 producers, const u32 consumers, const u64 count_per_producer, const u64 batch_size)
+{
+    const u64 total = producers * count_per_producer;
+    std::atomic<u64> consumed = 0;
+    std::vector<std::vector<u64>> seen(consumers, std::vector<u64>(producers, 0));
+    std::unique_ptr<std::atomic_bool[]> in_order = std::make_unique<std::atomic_bool[]>(consumers);
+
+    const auto start_time = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (u32 i = 0; i < producers; i++)
+    {
+        threads.emplace_back([&, i] { produce(queue, i, count_per_producer, batch_size); });
+    }
+    for (u32 i = 0; i < consumers; i++)
+    {
+        threads.emplace_back([&, i] { in_order[i] = consume(queue, consumed, total, batch_size, seen[i]); });
+    }
+    for (std::thread& thread : threads) thread.join();
+    const f64 seconds = std::chrono::duration<f64>(std::chrono::steady_clock::now() - start_time).count();
+
+    bool passed = consumed.load() == total;
+    for (u32 producer = 0; producer < producers; producer++)
+    {
+        u64 count = 0;
+        for (u32 consumer = 0; consumer < consumers; consumer++) count += seen[consumer][producer];
+        passed &= count == count_per_producer;
+    }
+    for (u32 consumer = 0; consumer < consumers; consumer++) passed &= in_order[consumer].load();
+
+    return {passed, seconds};
+}
+
+///Throughput in millions of values per second
+void print_result(const std::string& name, const run_result& result, const u64 total)
+{
+    std::cout << std::left << std::setw(44) << name << std::right << std::fixed << std::setprecision(1)
+        << std::setw(10) << static_cast<f64>(total) / result.seconds / 1e6 << " M/s" << (result.passed ? "" : "   FAILED") << '\n';
+}
+
+///Stress tests the lock-free queues for lost, duplicated or reordered values under concurrent single and batched pushes/pops,
+///with small rings so indices wrap constantly, then benchmarks their throughput against a locked deque.
+///Exits with 1 if any run loses, duplicates or reorders a value.
+///Usage: hyengine-queue-stress [values per producer]
+int main(const int argc, char** argv)
+{
+    const u64 count = argc > 1 ? std::stoull(argv[1]) : 1000000;
+    const u32 max_threads = std::max(std::thread::hardware_concurrency() / 2, 2u);
+    std::vector<u32> stress_threads = {1, 2};
+    if (max_threads > 2) stress_threads.push_back(max_threads);
+    bool passed = true;
+
+    std::cout << "Stress (capacity " << STRESS_CAPACITY << ", " << count << " values per producer)\n";
+    for (const u64 batch_size : BATCH_SIZES)
+    {
+        const std::string batching = batch_size > 1 ? " batched" : "";
+
+        std::unique_ptr<hyengine::spsc_queue<u64, STRESS_CAPACITY>> spsc = std::make_unique<hyengine::spsc_queue<u64, STRESS_CAPACITY>>();
+        const run_result spsc_result = run_queue(*spsc, 1, 1, count, batch_size);
+        print_result("  spsc 1x1" + batching, spsc_result, count);
+        passed &= spsc_result.passed;
+
+        for (const u32 threads : stress_threads)
+        {
+            std::unique_ptr<hyengine::mpmc_queue<u64, STRESS_CAPACITY>> mpmc = std::make_unique<hyengine::mpmc_queue<u64, STRESS_CAPACITY>>();
+            const run_result mpmc_result = run_queue(*mpmc, threads, threads, count, batch_size);
+            print_result("  mpmc " + std::to_string(threads) + "x" + std::to_string(threads) + batching, mpmc_result, threads * count);
+            passed &= mpmc_result.passed;
+        }
+    }
+
+    std::cout << "\nThroughput (capacity " << BENCHMARK_CAPACITY << ")\n";
+    for (const u64 batch_size : BATCH_SIZES)
+    {
+        const std::string batching = batch_size > 1 ? " batched" : "";
+
+        std::unique_ptr<hyengine::spsc_queue<u64, BENCHMARK_CAPACITY>> spsc = std::make_unique<hyengine::spsc_queue<u64, BENCHMARK_CAPACITY>>();
+        print_result("  spsc 1x1" + batching, run_queue(*spsc, 1, 1, count, batch_size), count);
+
+        for (const u32 threads : std::array<u32, 2> {1, max_threads})
+        {
+            const std::string shape = std::to_string(threads) + "x" + std::to_string(threads) + batching;
+
+            std::unique_ptr<hyengine::mpmc_queue<u64, BENCHMARK_CAPACITY>> mpmc = std::make_unique<hyengine::mpmc_queue<u64, BENCHMARK_CAPACITY>>();
+            print_result("  mpmc " + shape, run_queue(*mpmc, threads, threads, count, batch_size), threads * count);
+
+            locked_queue<u64, BENCHMARK_CAPACITY> locked;
+            print_result("  locked deque " + shape, run_queue(locked, threads, threads, count, batch_size), threads * count);
+        }
+    }
+
+    std::cout << (passed ? "\nAll stress runs passed\n" : "\nStress runs FAILED\n");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,152 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <span>
+#include <thread>
+
+#include "../sized_numerics.hpp"
+
+namespace hyengine
+{
+    ///Bounded lock-free multi producer, multi consumer ring queue (Vyukov's sequenced cell design).
+    ///Any number of threads may push and pop at the same time. Capacity must be a power of two.
+    template <typename type, u64 capacity>
+    class mpmc_queue
+    {
+        static_assert(capacity > 1 && (capacity & (capacity - 1)) == 0, "mpmc_queue capacity must be a power of two greater than one");
+
+    public:
+        mpmc_queue()
+        {
+            for (u64 i = 0; i < capacity; i++)
+            {
+                cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        mpmc_queue(const mpmc_queue&) = delete;
+        mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+        ///Returns false if the queue is full.
+        bool push(type value)
+        {
+            return push_batch_impl(&value, 1, true) == 1;
+        }
+
+        ///Claims as many consecutive free slots as are available (up to values.size()) with a single atomic operation, then fills them.
+        ///Returns how many values were pushed.
+        u64 push_batch(const std::span<const type> values)
+        {
+            return push_batch_impl(values.data(), values.size(), false);
+        }
+
+        ///Returns false if the queue is empty.
+        bool pop(type& value_out)
+        {
+            return pop_batch(std::span(&value_out, 1)) == 1;
+        }
+
+        ///Claims as many consecutive queued values as are available (up to values_out.size()) with a single atomic operation, then reads them.
+        ///Returns how many values were popped.
+        u64 pop_batch(const std::span<type> values_out)
+        {
+            if (values_out.empty()) return 0;
+
+            u64 position = dequeue_position.load(std::memory_order_relaxed);
+            u64 count;
+            while (true)
+            {
+                const u64 sequence = cells[position & mask].sequence.load(std::memory_order_acquire);
+                const i64 difference = static_cast<i64>(sequence - (position + 1));
+                if (difference < 0) return 0; //Empty
+                if (difference > 0) //Another consumer got here first
+                {
+                    position = dequeue_position.load(std::memory_order_relaxed);
+                    continue;
+                }
+
+                //Only claim up to the last value that has been published. Everything before it has at least been claimed by a producer.
+                count = std::min<u64>(values_out.size(), capacity);
+                while (count > 1 && cells[(position + count - 1) & mask].sequence.load(std::memory_order_acquire) != position + count) count--;
+
+                if (dequeue_position.compare_exchange_weak(position, position + count, std::memory_order_relaxed)) break;
+            }
+
+            for (u64 i = 0; i < count; i++)
+            {
+                cell& current = cells[(position + i) & mask];
+                while (current.sequence.load(std::memory_order_acquire) != position + i + 1) std::this_thread::yield(); //Producer still writing
+
+                values_out[i] = std::move(current.value);
+                current.sequence.store(position + i + capacity, std::memory_order_release);
+            }
+
+            return count;
+        }
+
+        ///Approximate number of queued values, including ones still being written or read.
+        [[nodiscard]] u64 size() const
+        {
+            const u64 dequeue_index = dequeue_position.load(std::memory_order_relaxed);
+            const u64 enqueue_index = enqueue_position.load(std::memory_order_relaxed);
+            return enqueue_index > dequeue_index ? enqueue_index - dequeue_index : 0;
+        }
+
+        [[nodiscard]] bool empty() const
+        {
+            return size() == 0;
+        }
+
+    private:
+        struct cell
+        {
+            ///Equals the position a producer may write next, or that position + 1 once the value is ready for a consumer
+            std::atomic<u64> sequence;
+            type value;
+        };
+
+        u64 push_batch_impl(const type* values, const u64 value_count, const bool move_values)
+        {
+            if (value_count == 0) return 0;
+
+            u64 position = enqueue_position.load(std::memory_order_relaxed);
+            u64 count;
+            while (true)
+            {
+                const u64 sequence = cells[position & mask].sequence.load(std::memory_order_acquire);
+                const i64 difference = static_cast<i64>(sequence - position);
+                if (difference < 0) return 0; //Full
+                if (difference > 0) //Another producer got here first
+                {
+                    position = enqueue_position.load(std::memory_order_relaxed);
+                    continue;
+                }
+
+                //Only claim up to the last free cell. Everything before it has at least been claimed by a consumer.
+                count = std::min<u64>(value_count, capacity);
+                while (count > 1 && cells[(position + count - 1) & mask].sequence.load(std::memory_order_acquire) != position + count - 1) count--;
+
+                if (enqueue_position.compare_exchange_weak(position, position + count, std::memory_order_relaxed)) break;
+            }
+
+            for (u64 i = 0; i < count; i++)
+            {
+                cell& current = cells[(position + i) & mask];
+                while (current.sequence.load(std::memory_order_acquire) != position + i) std::this_thread::yield(); //Consumer still reading
+
+                if (move_values) current.value = std::move(const_cast<type&>(values[i]));
+                else current.value = values[i];
+                current.sequence.store(position + i + 1, std::memory_order_release);
+            }
+
+            return count;
+        }
+
+        static constexpr u64 mask = capacity - 1;
+
+        alignas(64) std::atomic<u64> enqueue_position = 0;
+        alignas(64) std::atomic<u64> dequeue_position = 0;
+        alignas(64) std::array<cell, capacity> cells;
+    };
+}
@@ -0,0 +1,104 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <span>
+
+#include "../sized_numerics.hpp"
+
+namespace hyengine
+{
+    ///Bounded lock-free single producer, single consumer ring queue.
+    ///One thread may push and one (other) thread may pop at the same time. Capacity must be a power of two.
+    template <typename type, u64 capacity>
+    class spsc_queue
+    {
+        static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "spsc_queue capacity must be a power of two");
+
+    public:
+        ///Producer thread only. Returns false if the queue is full.
+        bool push(type value)
+        {
+            const u64 tail_index = tail.load(std::memory_order_relaxed);
+            if (tail_index - cached_head >= capacity)
+            {
+                cached_head = head.load(std::memory_order_acquire);
+                if (tail_index - cached_head >= capacity) return false;
+            }
+
+            elements[tail_index & mask] = std::move(value);
+            tail.store(tail_index + 1, std::memory_order_release);
+            return true;
+        }
+
+        ///Producer thread only. Pushes as many values as fit, publishing them all at once. Returns how many were pushed.
+        u64 push_batch(const std::span<const type> values)
+        {
+            const u64 tail_index = tail.load(std::memory_order_relaxed);
+            if (capacity - (tail_index - cached_head) < values.size()) cached_head = head.load(std::memory_order_acquire);
+
+            const u64 count = std::min<u64>(values.size(), capacity - (tail_index - cached_head));
+            for (u64 i = 0; i < count; i++)
+            {
+                elements[(tail_index + i) & mask] = values[i];
+            }
+
+            if (count > 0) tail.store(tail_index + count, std::memory_order_release);
+            return count;
+        }
+
+        ///Consumer thread only. Returns false if the queue is empty.
+        bool pop(type& value_out)
+        {
+            const u64 head_index = head.load(std::memory_order_relaxed);
+            if (head_index == cached_tail)
+            {
+                cached_tail = tail.load(std::memory_order_acquire);
+                if (head_index == cached_tail) return false;
+            }
+
+            value_out = std::move(elements[head_index & mask]);
+            head.store(head_index + 1, std::memory_order_release);
+            return true;
+        }
+
+        ///Consumer thread only. Pops up to values_out.size() values, freeing their slots all at once. Returns how many were popped.
+        u64 pop_batch(const std::span<type> values_out)
+        {
+            const u64 head_index = head.load(std::memory_order_relaxed);
+            if (cached_tail - head_index < values_out.size()) cached_tail = tail.load(std::memory_order_acquire);
+
+            const u64 count = std::min<u64>(values_out.size(), cached_tail - head_index);
+            for (u64 i = 0; i < count; i++)
+            {
+                values_out[i] = std::move(elements[(head_index + i) & mask]);
+            }
+
+            if (count > 0) head.store(head_index + count, std::memory_order_release);
+            return count;
+        }
+
+        ///Approximate number of queued values. Exact when neither end is in use.
+        [[nodiscard]] u64 size() const
+        {
+            const u64 head_index = head.load(std::memory_order_acquire);
+            const u64 tail_index = tail.load(std::memory_order_acquire);
+            return tail_index - head_index;
+        }
+
+        [[nodiscard]] bool empty() const
+        {
+            return size() == 0;
+        }
+
+    private:
+        static constexpr u64 mask = capacity - 1;
+
+        //Each end keeps a stale copy of the other end's index, so it only touches the other end's cache line when it looks full/empty
+        alignas(64) std::atomic<u64> head = 0;
+        u64 cached_tail = 0;
+        alignas(64) std::atomic<u64> tail = 0;
+        u64 cached_head = 0;
+        alignas(64) std::array<type, capacity> elements {};
+    };
+}
@@ -0,0 +1,90 @@
+#pragma once
+#include <array>
+#include <atomic>
+
+#include "../sized_numerics.hpp"
+
+namespace hyengine
+{
+    ///Bounded lock-free Chase-Lev work stealing deque.
+    ///The owning thread pushes and pops from the bottom (LIFO), any other thread may steal from the top (FIFO).
+    ///Capacity must be a power of two. Intended for small trivially-copyable values such as pointers.
+    template <typename type, i64 capacity>
+    class work_stealing_deque
+    {
+        static_assert(capacity > 0 && (capacity & (capacity - 1)) == 0, "work_stealing_deque capacity must be a power of two");
+
+    public:
+        ///Owner thread only. Returns false if the deque is full.
+        bool push(const type value)
+        {
+            const i64 bottom_index = bottom.load(std::memory_order_relaxed);
+            const i64 top_index = top.load(std::memory_order_acquire);
+            if (bottom_index - top_index >= capacity) return false;
+
+            elements[bottom_index & mask].store(value, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            bottom.store(bottom_index + 1, std::memory_order_relaxed);
+            return true;
+        }
+
+        ///Owner thread only. Takes the most recently pushed value. Returns false if the deque is empty or the last value was stolen.
+        bool pop(type& value_out)
+        {
+            const i64 bottom_index = bottom.load(std::memory_order_relaxed) - 1;
+            bottom.store(bottom_index, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            i64 top_index = top.load(std::memory_order_relaxed);
+
+            if (top_index > bottom_index) //Empty
+            {
+                bottom.store(bottom_index + 1, std::memory_order_relaxed);
+                return false;
+            }
+
+            value_out = elements[bottom_index & mask].load(std::memory_order_relaxed);
+            if (top_index != bottom_index) return true; //More than one element, no race possible
+
+            //Last element - race against thieves for it
+            const bool won = top.compare_exchange_strong(top_index, top_index + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(bottom_index + 1, std::memory_order_relaxed);
+            return won;
+        }
+
+        ///Any thread. Takes the oldest pushed value. Returns false if the deque is empty or another thread won the race for the value.
+        bool steal(type& value_out)
+        {
+            i64 top_index = top.load(std::memory_order_acquire);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            const i64 bottom_index = bottom.load(std::memory_order_acquire);
+
+            if (top_index >= bottom_index) return false;
+
+            const type value = elements[top_index & mask].load(std::memory_order_relaxed);
+            if (!top.compare_exchange_strong(top_index, top_index + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) return false;
+
+            value_out = value;
+            return true;
+        }
+
+        ///Approximate number of values in the deque. Only exact when called from the owner thread with no concurrent thieves.
+        [[nodiscard]] i64 size() const
+        {
+            const i64 bottom_index = bottom.load(std::memory_order_relaxed);
+            const i64 top_index = top.load(std::memory_order_relaxed);
+            return bottom_index > top_index ? bottom_index - top_index : 0;
+        }
+
+        [[nodiscard]] bool empty() const
+        {
+            return size() == 0;
+        }
+
+    private:
+        static constexpr i64 mask = capacity - 1;
+
+        alignas(64) std::atomic<i64> top = 0;
+        alignas(64) std::atomic<i64> bottom = 0;
+        alignas(64) std::array<std::atomic<type>, capacity> elements {};
+    };
+}
@@ -0,0 +1,60 @@
+#include "scratch_arena.hpp"
+
+#include <algorithm>
+#include <tracy/Tracy.hpp>
+
+namespace hyengine
+{
+    scratch_arena::scratch_arena(const u64 block_size) : default_block_size(block_size) {}
+
+    void* scratch_arena::allocate(const u64 size, const u64 alignment)
+    {
+        while (current_block < blocks.size())
+        {
+            const memory_block& block = blocks[current_block];
+            const u64 address = reinterpret_cast<u64>(block.data.get());
+            const u64 aligned_offset = (address + current_offset + alignment - 1) / alignment * alignment - address;
+
+            if (aligned_offset + size <= block.size)
+            {
+                current_offset = aligned_offset + size;
+                return block.data.get() + aligned_offset;
+            }
+
+            //Doesn't fit - move on to the next block, which may already exist from before a rewind
+            current_block++;
+            current_offset = 0;
+        }
+
+        ZoneScoped;
+        const u64 block_size = std::max(default_block_size, size + alignment);
+        blocks.push_back({std::make_unique<std::byte[]>(block_size), block_size});
+        current_block = static_cast<u32>(blocks.size() - 1);
+        current_offset = 0;
+        return allocate(size, alignment);
+    }
+
+    scratch_arena::marker scratch_arena::get_marker() const
+    {
+        return {current_block, current_offset};
+    }
+
+    void scratch_arena::rewind(const marker& to)
+    {
+        current_block = to.block_index;
+        current_offset = to.offset;
+    }
+
+    void scratch_arena::reset()
+    {
+        current_block = 0;
+        current_offset = 0;
+    }
+
+    u64 scratch_arena::get_capacity() const
+    {
+        u64 capacity = 0;
+        for (const memory_block& block : blocks) capacity += block.size;
+        return capacity;
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "sized_numerics.hpp"
+
+namespace hyengine
+{
+    ///Bump allocator for short-lived scratch memory. Nothing is freed individually - rewind to a marker or reset to release everything allocated since.
+    ///Memory blocks are kept around for reuse, so steady-state use doesn't touch the heap. Not thread safe; each thread has its own in its thread_context.
+    class scratch_arena
+    {
+    public:
+        struct marker
+        {
+            u32 block_index;
+            u64 offset;
+        };
+
+        explicit scratch_arena(const u64 block_size = 64 * 1024);
+
+        scratch_arena(const scratch_arena& other) = delete;
+        scratch_arena& operator=(const scratch_arena& other) = delete;
+
+        [[nodiscard]] void* allocate(const u64 size, const u64 alignment = alignof(std::max_align_t));
+
+        ///Uninitialized storage for count values of the given type.
+        template <typename type>
+        [[nodiscard]] type* allocate_array(const u64 count)
+        {
+            return static_cast<type*>(allocate(sizeof(type) * count, alignof(type)));
+        }
+
+        [[nodiscard]] marker get_marker() const;
+
+        ///Releases everything allocated since the marker was taken.
+        void rewind(const marker& to);
+
+        ///Releases everything allocated from the arena.
+        void reset();
+
+        [[nodiscard]] u64 get_capacity() const;
+
+    private:
+        struct memory_block
+        {
+            std::unique_ptr<std::byte[]> data;
+            u64 size;
+        };
+
+        std::vector<memory_block> blocks;
+        u64 default_block_size;
+        u32 current_block = 0;
+        u64 current_offset = 0;
+    };
+
+    ///Rewinds a scratch arena to where it was when the scope was created.
+    class scratch_scope
+    {
+    public:
+        explicit scratch_scope(scratch_arena& arena) : arena(arena), start(arena.get_marker()) {}
+        ~scratch_scope()
+        {
+            arena.rewind(start);
+        }
+
+        scratch_scope(const scratch_scope& other) = delete;
+        scratch_scope& operator=(const scratch_scope& other) = delete;
+
+    private:
+        scratch_arena& arena;
+        scratch_arena::marker start;
+    };
+}
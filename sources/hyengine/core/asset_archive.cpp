@@ -0,0 +1,186 @@
+#include "asset_archive.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <tracy/Tracy.hpp>
+
+#include "logger.hpp"
+#include "hyengine/common/common.hpp"
+
+namespace hyengine
+{
+    using namespace asset_archive_format;
+
+    static bool entry_less(const index_entry& entry, const u32 id_hash, const std::string_view& id, const char* ids)
+    {
+        if (entry.id_hash != id_hash) return entry.id_hash < id_hash;
+        return std::string_view(ids + entry.id_offset, entry.id_length) < id;
+    }
+
+    ///Continues a CRC-32 (as in string_hash) over more bytes. Start from 0xffffffff and invert the result.
+    static u32 crc_update(u32 crc, const std::byte* bytes, const u64 size)
+    {
+        for (u64 i = 0; i < size; i++)
+        {
+            crc = (crc >> 8) ^ CRC_TABLE[(crc ^ static_cast<u8>(bytes[i])) & 0xff];
+        }
+        return crc;
+    }
+
+    bool asset_archive::open(const std::filesystem::path& path)
+    {
+        ZoneScoped;
+        entries = nullptr;
+        entry_count = 0;
+        content_hash = 0;
+        if (!file.open_read(path)) return false;
+
+        file_header header {};
+        if (file.size() >= sizeof(file_header)) std::memcpy(&header, file.data(), sizeof(file_header));
+
+        const u64 index_size = static_cast<u64>(header.entry_count) * sizeof(index_entry);
+        if (header.magic != FILE_MAGIC || header.version != VERSION || header.index_offset % alignof(index_entry) != 0 || header.index_offset + index_size > file.size())
+        {
+            log_error(logger_tags::FILEIO, "'", path.string(), "' isn't a valid asset archive");
+            file.close();
+            return false;
+        }
+
+        const index_entry* index = reinterpret_cast<const index_entry*>(file.data() + header.index_offset);
+        for (u32 i = 0; i < header.entry_count; i++)
+        {
+            if (index[i].offset + index[i].size > file.size() || index[i].id_offset + index[i].id_length > file.size())
+            {
+                log_error(logger_tags::FILEIO, "Asset archive '", path.string(), "' is truncated");
+                file.close();
+                return false;
+            }
+        }
+
+        this->path = path;
+        entries = index;
+        entry_count = header.entry_count;
+        content_hash = header.content_hash;
+        return true;
+    }
+
+    bool asset_archive::find(const std::string_view& asset_id, std::span<const u8>& bytes_out) const
+    {
+        if (entry_count == 0) return false;
+
+        const char* ids = reinterpret_cast<const char*>(file.data());
+        const u32 id_hash = string_hash(asset_id);
+        const index_entry* entry = std::lower_bound(entries, entries + entry_count, asset_id, [&](const index_entry& lhs, const std::string_view& id)
+        {
+            return entry_less(lhs, id_hash, id, ids);
+        });
+
+        if (entry == entries + entry_count || entry->id_hash != id_hash || std::string_view(ids + entry->id_offset, entry->id_length) != asset_id) return false;
+
+        bytes_out = std::span(reinterpret_cast<const u8*>(file.data()) + entry->offset, entry->size);
+        return true;
+    }
+
+    bool asset_archive::contains(const std::string_view& asset_id) const
+    {
+        std::span<const u8> bytes;
+        return find(asset_id, bytes);
+    }
+
+    u32 asset_archive::get_entry_count() const
+    {
+        return entry_count;
+    }
+
+    const std::filesystem::path& asset_archive::get_path() const
+    {
+        return path;
+    }
+
+    u32 asset_archive::get_content_hash() const
+    {
+        return content_hash;
+    }
+
+    static void write_padding(std::ofstream& output, u64& offset, const u64 alignment)
+    {
+        constexpr char zeroes[BLOB_ALIGNMENT] {};
+        const u64 padding = (alignment - offset % alignment) % alignment;
+        output.write(zeroes, static_cast<std::streamsize>(padding));
+        offset += padding;
+    }
+
+    bool write_asset_archive(const std::filesystem::path& path, std::vector<asset_archive_input> inputs)
+    {
+        ZoneScoped;
+        std::sort(inputs.begin(), inputs.end(), [](const asset_archive_input& lhs, const asset_archive_input& rhs)
+        {
+            const u32 lhs_hash = string_hash(lhs.id);
+            const u32 rhs_hash = string_hash(rhs.id);
+            return lhs_hash != rhs_hash ? lhs_hash < rhs_hash : lhs.id < rhs.id;
+        });
+
+        for (u64 i = 1; i < inputs.size(); i++)
+        {
+            if (inputs[i].id == inputs[i - 1].id)
+            {
+                log_error(logger_tags::FILEIO, "Asset '", inputs[i].id, "' is packed twice, from '", inputs[i - 1].source.string(), "' and '", inputs[i].source.string(), "'");
+                return false;
+            }
+        }
+
+        std::ofstream output(path, std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!output.is_open())
+        {
+            log_error(logger_tags::FILEIO, "Couldn't create asset archive '", path.string(), "'");
+            return false;
+        }
+
+        //Header is rewritten once the index offset is known
+        file_header header = {FILE_MAGIC, VERSION, 0, static_cast<u32>(inputs.size()), 0, 0};
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        u64 offset = sizeof(header);
+
+        std::vector<index_entry> index(inputs.size());
+        u32 content_crc = 0xffffffff;
+        for (u64 i = 0; i < inputs.size(); i++)
+        {
+            mapped_file source;
+            if (!source.open_read(inputs[i].source))
+            {
+                log_error(logger_tags::FILEIO, "Couldn't read '", inputs[i].source.string(), "' into asset archive");
+                return false;
+            }
+
+            write_padding(output, offset, BLOB_ALIGNMENT);
+            index[i] = {string_hash(inputs[i].id), static_cast<u32>(inputs[i].id.size()), 0, offset, source.size()};
+            output.write(reinterpret_cast<const char*>(source.data()), static_cast<std::streamsize>(source.size()));
+            offset += source.size();
+            content_crc = crc_update(content_crc, source.data(), source.size());
+        }
+
+        for (u64 i = 0; i < inputs.size(); i++)
+        {
+            index[i].id_offset = offset;
+            output.write(inputs[i].id.data(), static_cast<std::streamsize>(inputs[i].id.size()));
+            offset += inputs[i].id.size();
+        }
+
+        write_padding(output, offset, alignof(index_entry));
+        header.index_offset = offset;
+        header.content_hash = content_crc ^ 0xffffffff;
+        output.write(reinterpret_cast<const char*>(index.data()), static_cast<std::streamsize>(index.size() * sizeof(index_entry)));
+
+        output.seekp(0);
+        output.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        output.close();
+
+        if (output.fail())
+        {
+            log_error(logger_tags::FILEIO, "Failed writing asset archive '", path.string(), "'");
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.hpp"
+#include "hyengine/common/sized_numerics.hpp"
+
+namespace hyengine
+{
+    ///Layout of a packed asset archive: a file_header, the asset blobs (each aligned to BLOB_ALIGNMENT), the asset IDs, then the index.
+    ///The index is sorted by the string_hash of each asset ID (then by the ID itself), so lookups are a binary search over the mapped file.
+    ///All values are little endian.
+    namespace asset_archive_format
+    {
+        constexpr u32 FILE_MAGIC = 0x4B505948; //"HYPK"
+        constexpr u16 VERSION = 1;
+        constexpr u64 BLOB_ALIGNMENT = 16;
+
+        struct file_header
+        {
+            u32 magic;
+            u16 version;
+            u16 reserved;
+            u32 entry_count;
+            u32 content_hash; //CRC-32 of every asset blob in index order, so caches built from an archive can tell when it's been repacked
+            u64 index_offset;
+        };
+
+        struct index_entry
+        {
+            u32 id_hash;
+            u32 id_length;
+            u64 id_offset;
+            u64 offset;
+            u64 size;
+        };
+    }
+
+    ///File to pack into an archive under the given asset ID
+    struct asset_archive_input
+    {
+        std::string id;
+        std::filesystem::path source;
+    };
+
+    ///Read-only packed asset archive, memory mapped. See mount_asset_archive to load assets from it.
+    class asset_archive
+    {
+    public:
+        [[nodiscard]] bool open(const std::filesystem::path& path);
+
+        ///Finds an asset's bytes in the archive. Returns false if it isn't in the archive.
+        [[nodiscard]] bool find(const std::string_view& asset_id, std::span<const u8>& bytes_out) const;
+        [[nodiscard]] bool contains(const std::string_view& asset_id) const;
+
+        [[nodiscard]] u32 get_entry_count() const;
+        [[nodiscard]] const std::filesystem::path& get_path() const;
+        [[nodiscard]] u32 get_content_hash() const;
+
+    private:
+        std::filesystem::path path;
+        mapped_file file;
+        const asset_archive_format::index_entry* entries = nullptr;
+        u32 entry_count = 0;
+        u32 content_hash = 0;
+    };
+
+    ///Packs the given files into an archive at path. Fails if a source can't be read or an ID appears twice.
+    [[nodiscard]] bool write_asset_archive(const std::filesystem::path& path, std::vector<asset_archive_input> inputs);
+}
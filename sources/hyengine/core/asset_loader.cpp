@@ -0,0 +1,99 @@
+#include "asset_loader.hpp"
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <tracy/Tracy.hpp>
+
+namespace hyengine
+{
+    ///Loads taken from the queue at a time by an IO job
+    static constexpr u32 ASSET_IO_BATCH_SIZE = 8;
+
+    static std::mutex asset_io_lock;
+    static std::deque<std::function<void()>> pending_asset_loads;
+    static u32 asset_io_jobs_in_flight = 0;
+    static u32 max_asset_io_jobs = 2;
+
+    static void start_asset_io_job();
+
+    static void run_asset_io_job()
+    {
+        ZoneScopedN("Asset IO job");
+        std::vector<std::function<void()>> batch;
+
+        asset_io_lock.lock();
+        while (!pending_asset_loads.empty() && batch.size() < ASSET_IO_BATCH_SIZE)
+        {
+            batch.push_back(std::move(pending_asset_loads.front()));
+            pending_asset_loads.pop_front();
+        }
+        asset_io_lock.unlock();
+
+        for (const std::function<void()>& load : batch)
+        {
+            load();
+        }
+
+        //Hand the worker back between batches, so frame work isn't stuck behind a long queue of loads
+        asset_io_lock.lock();
+        const bool more_pending = !pending_asset_loads.empty();
+        if (!more_pending) asset_io_jobs_in_flight--;
+        asset_io_lock.unlock();
+
+        if (more_pending) start_asset_io_job();
+    }
+
+    static void start_asset_io_job()
+    {
+        function_task* job = new function_task(run_asset_io_job);
+        job->set_priority(task_priority::BACKGROUND);
+        job->enqueue_detached();
+    }
+
+    void set_max_asset_io_jobs(const u32 count)
+    {
+        asset_io_lock.lock();
+        max_asset_io_jobs = std::max(count, 1u);
+        asset_io_lock.unlock();
+    }
+
+    void enqueue_asset_io(std::function<void()> load)
+    {
+        asset_io_lock.lock();
+        pending_asset_loads.push_back(std::move(load));
+        const bool start_job = asset_io_jobs_in_flight < max_asset_io_jobs;
+        if (start_job) asset_io_jobs_in_flight++;
+        asset_io_lock.unlock();
+
+        if (start_job) start_asset_io_job();
+    }
+
+    template <typename result_type, typename load_function>
+    asset_future<result_type> load_asset_async(const std::string_view& id, const load_function& load, std::function<void(const result_type&)> on_loaded)
+    {
+        std::shared_ptr<asset_load_state<result_type>> state = std::make_shared<asset_load_state<result_type>>();
+        enqueue_asset_io([state, id = std::string(id), load, on_loaded = std::move(on_loaded)]
+        {
+            state->result = load(id);
+            state->loaded.store(true, std::memory_order_release);
+            if (on_loaded) enqueue_main_thread([state, on_loaded] { on_loaded(state->result); });
+        });
+        return asset_future<result_type>(std::move(state));
+    }
+
+    asset_future<std::string> load_asset_text_async(const std::string_view& id, std::function<void(const std::string&)> on_loaded)
+    {
+        return load_asset_async<std::string>(id, [](const std::string_view& asset_id) { return load_asset_text(asset_id); }, std::move(on_loaded));
+    }
+
+    asset_future<std::vector<u8>> load_asset_bytes_async(const std::string_view& id, std::function<void(const std::vector<u8>&)> on_loaded)
+    {
+        return load_asset_async<std::vector<u8>>(id, [](const std::string_view& asset_id) { return load_asset_bytes(asset_id); }, std::move(on_loaded));
+    }
+
+    asset_future<asset_image_data> load_asset_image_async(const std::string_view& id, std::function<void(const asset_image_data&)> on_loaded)
+    {
+        return load_asset_async<asset_image_data>(id, [](const std::string_view& asset_id) { return load_asset_image(asset_id); }, std::move(on_loaded));
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "file_io.hpp"
+#include "../threading/threading.hpp"
+
+namespace hyengine
+{
+    ///Result of an asynchronous asset load, shared by the load and its futures
+    template <typename result_type>
+    struct asset_load_state
+    {
+        result_type result {};
+        std::atomic_bool loaded = false;
+    };
+
+    ///Handle to an asset being loaded on the threadpool
+    template <typename result_type>
+    class asset_future
+    {
+    public:
+        asset_future() = default;
+        explicit asset_future(std::shared_ptr<asset_load_state<result_type>> state) : state(std::move(state)) {}
+
+        [[nodiscard]] bool valid() const
+        {
+            return state != nullptr;
+        }
+
+        [[nodiscard]] bool ready() const
+        {
+            return state->loaded.load(std::memory_order_acquire);
+        }
+
+        ///Blocks until the asset has loaded, executing queued tasks (and main thread tasks, if on the main thread) while waiting -
+        ///safe to call from inside a task.
+        [[nodiscard]] const result_type& get() const
+        {
+            while (!ready())
+            {
+                if (!help_execute_next_task()) std::this_thread::yield();
+            }
+            return state->result;
+        }
+
+    private:
+        std::shared_ptr<asset_load_state<result_type>> state;
+    };
+
+    ///Limits how many asset IO jobs run on the threadpool at once (default 2). Each job loads queued assets in batches until the queue is empty,
+    ///so a burst of requests doesn't tie up every worker with disk reads.
+    void set_max_asset_io_jobs(u32 count);
+
+    ///Queues a function to run on an asset IO job. Used by the load_asset_*_async functions.
+    void enqueue_asset_io(std::function<void()> load);
+
+    ///Loads an asset on the threadpool. on_loaded, if set, is called on the main thread with the result once it's ready.
+    asset_future<std::string> load_asset_text_async(const std::string_view& id, std::function<void(const std::string&)> on_loaded = {});
+    asset_future<std::vector<u8>> load_asset_bytes_async(const std::string_view& id, std::function<void(const std::vector<u8>&)> on_loaded = {});
+
+    ///Loads and decodes an image on the threadpool. The caller owns the pixel data, as with load_asset_image.
+    asset_future<asset_image_data> load_asset_image_async(const std::string_view& id, std::function<void(const asset_image_data&)> on_loaded = {});
+}
@@ -0,0 +1,344 @@
+#include "binary_log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <tracy/Tracy.hpp>
+
+#include "file_io.hpp"
+#include "hyengine/common/common.hpp"
+
+namespace hyengine
+{
+    using namespace binary_log_format;
+
+    static constexpr u64 MIN_FILE_SIZE = 4096;
+
+    static constexpr u64 string_record_size(const std::string_view text)
+    {
+        return sizeof(record_kind) + sizeof(string_record) + text.size();
+    }
+
+    ///Size of one encoded argument, or 0 for OPAQUE, whose size only its log_argument knows
+    static u64 encoded_argument_size(const char code, const std::byte* source)
+    {
+        using namespace log_argument_codes;
+        switch (code)
+        {
+            case STRING:
+            {
+                u32 length;
+                std::memcpy(&length, source, sizeof(u32));
+                return sizeof(u32) + length;
+            }
+            case BOOL: return sizeof(bool);
+            case CHAR: return sizeof(char);
+            case I16: case U16: return sizeof(u16);
+            case I32: case U32: return sizeof(u32);
+            case I64: case U64: return sizeof(u64);
+            case F32: return sizeof(f32);
+            case F64: return sizeof(f64);
+            default: return 0;
+        }
+    }
+
+    template <typename type>
+    static void format_encoded_value(std::ostream& output, const std::byte* source)
+    {
+        type value;
+        std::memcpy(&value, source, sizeof(type));
+        output << value;
+    }
+
+    ///Formats arguments the way log_format::format would have, from their signature alone. Returns false if they're truncated or have an unknown code.
+    static bool format_encoded_arguments(std::ostream& output, const std::string_view signature, const std::span<const std::byte> arguments)
+    {
+        using namespace log_argument_codes;
+        output << std::fixed << std::setprecision(2);
+
+        u64 offset = 0;
+        for (const char code : signature)
+        {
+            if (code == STRING && offset + sizeof(u32) > arguments.size()) return false;
+
+            const u64 size = encoded_argument_size(code, arguments.data() + offset);
+            if (size == 0 || offset + size > arguments.size()) return false;
+
+            const std::byte* source = arguments.data() + offset;
+            switch (code)
+            {
+                case STRING: output << std::string_view(reinterpret_cast<const char*>(source + sizeof(u32)), size - sizeof(u32)); break;
+                case BOOL: format_encoded_value<bool>(output, source); break;
+                case CHAR: format_encoded_value<char>(output, source); break;
+                case I16: format_encoded_value<i16>(output, source); break;
+                case U16: format_encoded_value<u16>(output, source); break;
+                case I32: format_encoded_value<i32>(output, source); break;
+                case U32: format_encoded_value<u32>(output, source); break;
+                case I64: format_encoded_value<i64>(output, source); break;
+                case U64: format_encoded_value<u64>(output, source); break;
+                case F32: format_encoded_value<f32>(output, source); break;
+                case F64: format_encoded_value<f64>(output, source); break;
+                default: return false;
+            }
+            offset += size;
+        }
+        return true;
+    }
+
+    bool binary_log_writer::open(const std::filesystem::path& path, const u64 max_file_size, const u32 max_rotated_files)
+    {
+        close();
+        this->path = path;
+        this->max_file_size = std::max(max_file_size, MIN_FILE_SIZE);
+        this->max_rotated_files = max_rotated_files;
+
+        //Keep whatever the last run logged rather than overwriting it
+        if (std::filesystem::exists(path)) rotate();
+        return start_file();
+    }
+
+    void binary_log_writer::close()
+    {
+        file.close(offset);
+        written_strings.clear();
+        offset = 0;
+    }
+
+    bool binary_log_writer::is_open() const
+    {
+        return file.is_open();
+    }
+
+    bool binary_log_writer::write(const u64 timestamp, const u32 thread_id, const std::string_view tag_id, const std::string_view type, const std::string_view signature,
+                                  std::string_view payload)
+    {
+        ZoneScoped;
+        if (!file.is_open()) return true;
+
+        const u32 tag_hash = string_hash(tag_id);
+        const u32 type_hash = string_hash(type);
+        const u32 format_hash = signature.empty() ? 0 : string_hash(signature);
+        const auto strings_size = [&]
+        {
+            u64 size = 0;
+            if (!written_strings.contains(tag_hash)) size += string_record_size(tag_id);
+            if (type_hash != tag_hash && !written_strings.contains(type_hash)) size += string_record_size(type);
+            if (!signature.empty() && !written_strings.contains(format_hash)) size += string_record_size(signature);
+            return size;
+        };
+
+        //Clip text that wouldn't fit even in an empty file. Clipping arguments would leave them undecodable, so those are dropped instead.
+        const u64 fixed_size = sizeof(file_header) + string_record_size(tag_id) + string_record_size(type) + string_record_size(signature) + sizeof(record_kind) + sizeof(message_record);
+        if (fixed_size >= max_file_size) return true;
+        if (!signature.empty() && fixed_size + payload.size() > max_file_size) return false;
+        payload = payload.substr(0, std::min<u64>(payload.size(), max_file_size - fixed_size));
+
+        if (offset + strings_size() + sizeof(record_kind) + sizeof(message_record) + payload.size() > file.size())
+        {
+            rotate();
+            if (!start_file()) return true;
+        }
+
+        if (!written_strings.contains(tag_hash)) append_string(tag_hash, tag_id);
+        if (!written_strings.contains(type_hash)) append_string(type_hash, type);
+        if (!signature.empty() && !written_strings.contains(format_hash)) append_string(format_hash, signature);
+
+        constexpr record_kind kind = record_kind::MESSAGE;
+        const message_record record = {timestamp, thread_id, tag_hash, type_hash, format_hash, static_cast<u32>(payload.size())};
+        append(&kind, sizeof(kind));
+        append(&record, sizeof(record));
+        append(payload.data(), payload.size());
+        return true;
+    }
+
+    void binary_log_writer::flush() const
+    {
+        file.flush_async();
+    }
+
+    bool binary_log_writer::start_file()
+    {
+        if (!file.create(path, max_file_size)) return false;
+
+        const u64 timestamp = static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+        const file_header header = {FILE_MAGIC, VERSION, 0, timestamp};
+        append(&header, sizeof(header));
+        return true;
+    }
+
+    void binary_log_writer::rotate()
+    {
+        close();
+        rotate_files(path, max_rotated_files);
+    }
+
+    void binary_log_writer::append(const void* data, const u64 size)
+    {
+        std::memcpy(file.data() + offset, data, size);
+        offset += size;
+    }
+
+    void binary_log_writer::append_string(const u32 id, const std::string_view text)
+    {
+        constexpr record_kind kind = record_kind::STRING;
+        const string_record record = {id, static_cast<u32>(text.size())};
+        append(&kind, sizeof(kind));
+        append(&record, sizeof(record));
+        append(text.data(), text.size());
+        written_strings.insert(id);
+    }
+
+    bool binary_log_sink::open(const std::filesystem::path& path, const u64 max_file_size, const u32 max_rotated_files)
+    {
+        return writer.open(path, max_file_size, max_rotated_files);
+    }
+
+    void binary_log_sink::close()
+    {
+        writer.close();
+    }
+
+    void binary_log_sink::write(const std::span<const log_message> messages)
+    {
+        for (const log_message& message : messages)
+        {
+            if (message.descriptor == nullptr)
+            {
+                writer.write(message.timestamp, message.thread_id, message.tag_id, message.type, {}, message.message);
+                continue;
+            }
+
+            const std::string_view signature = message.descriptor->signature;
+            if (signature.find(log_argument_codes::OPAQUE) == std::string_view::npos)
+            {
+                if (!writer.write(message.timestamp, message.thread_id, message.tag_id, message.type, signature, message.encoded_arguments)) write_clipped(message);
+                continue;
+            }
+
+            //The decoder can't know how to format enums, value types or manipulators, so store them as text
+            converted_arguments.clear();
+            const std::byte* source = reinterpret_cast<const std::byte*>(message.encoded_arguments.data());
+            for (u64 i = 0; i < signature.size(); i++)
+            {
+                if (signature[i] == log_argument_codes::OPAQUE)
+                {
+                    std::stringstream output;
+                    output << std::fixed << std::setprecision(2);
+                    source = message.descriptor->argument_formatters[i](output, source);
+                    const std::string text = output.str();
+                    const u32 length = static_cast<u32>(text.size());
+                    converted_arguments.append(reinterpret_cast<const char*>(&length), sizeof(length));
+                    converted_arguments.append(text);
+                }
+                else
+                {
+                    const u64 size = encoded_argument_size(signature[i], source);
+                    converted_arguments.append(reinterpret_cast<const char*>(source), size);
+                    source += size;
+                }
+            }
+            if (!writer.write(message.timestamp, message.thread_id, message.tag_id, message.type, get_stored_signature(*message.descriptor), converted_arguments))
+            {
+                write_clipped(message);
+            }
+        }
+        writer.flush();
+    }
+
+    void binary_log_sink::write_clipped(const log_message& message)
+    {
+        std::stringstream output;
+        message.descriptor->format(output, reinterpret_cast<const std::byte*>(message.encoded_arguments.data()));
+        writer.write(message.timestamp, message.thread_id, message.tag_id, message.type, {}, output.str());
+    }
+
+    const std::string& binary_log_sink::get_stored_signature(const log_format_descriptor& descriptor)
+    {
+        const auto cached = stored_signatures.find(&descriptor);
+        if (cached != stored_signatures.end()) return cached->second;
+
+        std::string signature(descriptor.signature);
+        std::ranges::replace(signature, log_argument_codes::OPAQUE, log_argument_codes::STRING);
+        return stored_signatures.emplace(&descriptor, std::move(signature)).first->second;
+    }
+
+    bool binary_log_reader::open(const std::filesystem::path& path)
+    {
+        offset = 0;
+        strings.clear();
+        if (!file.open_read(path)) return false;
+
+        file_header header;
+        if (!read(&header, sizeof(header)) || header.magic != FILE_MAGIC || header.version != VERSION)
+        {
+            file.close();
+            return false;
+        }
+
+        file_start_timestamp = header.start_timestamp;
+        return true;
+    }
+
+    bool binary_log_reader::next(binary_log_entry& entry_out)
+    {
+        record_kind kind;
+        while (read(&kind, sizeof(kind)))
+        {
+            if (kind == record_kind::STRING)
+            {
+                string_record record;
+                if (!read(&record, sizeof(record)) || offset + record.length > file.size()) return false;
+
+                strings[record.id] = std::string_view(reinterpret_cast<const char*>(file.data() + offset), record.length);
+                offset += record.length;
+            }
+            else if (kind == record_kind::MESSAGE)
+            {
+                message_record record;
+                if (!read(&record, sizeof(record)) || offset + record.length > file.size()) return false;
+
+                const auto lookup = [&](const u32 id) -> std::string_view
+                {
+                    const auto string = strings.find(id);
+                    return string != strings.end() ? string->second : "?";
+                };
+
+                const std::span<const std::byte> payload(reinterpret_cast<const std::byte*>(file.data() + offset), record.length);
+                offset += record.length;
+                entry_out = {record.timestamp, record.thread_id, lookup(record.tag_id), lookup(record.type_id), {}, {}, {}};
+                if (record.format_id == 0)
+                {
+                    entry_out.message = std::string_view(reinterpret_cast<const char*>(payload.data()), payload.size());
+                    return true;
+                }
+
+                entry_out.signature = lookup(record.format_id);
+                entry_out.arguments = payload;
+                std::stringstream output;
+                if (!format_encoded_arguments(output, entry_out.signature, payload)) output << " <undecodable arguments>";
+                formatted_message = output.str();
+                entry_out.message = formatted_message;
+                return true;
+            }
+            else return false; //END, or the unused zeroed tail of a file that wasn't closed
+        }
+        return false;
+    }
+
+    u64 binary_log_reader::start_timestamp() const
+    {
+        return file_start_timestamp;
+    }
+
+    bool binary_log_reader::read(void* data_out, const u64 size)
+    {
+        if (offset + size > file.size()) return false;
+
+        std::memcpy(data_out, file.data() + offset, size);
+        offset += size;
+        return true;
+    }
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <filesystem>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "logger.hpp"
+#include "mapped_file.hpp"
+#include "hyengine/common/sized_numerics.hpp"
+
+namespace hyengine
+{
+    ///Layout of a binary log file: a file_header, then a run of records each starting with a record_kind byte.
+    ///Tag and type names, and the log_argument_codes signature of each message's arguments, are written once per file as STRING records
+    ///and referred to by their string_hash afterwards. Messages store their arguments as encoded by log_argument, and are formatted when read back.
+    ///All values are little endian and unaligned.
+    namespace binary_log_format
+    {
+        constexpr u32 FILE_MAGIC = 0x474C5948; //"HYLG"
+        constexpr u16 VERSION = 2;
+
+        enum class record_kind : u8
+        {
+            END = 0, STRING = 1, MESSAGE = 2
+        };
+
+        struct file_header
+        {
+            u32 magic;
+            u16 version;
+            u16 reserved;
+            u64 start_timestamp;
+        };
+
+        ///Follows a STRING kind byte, then the string's characters
+        struct string_record
+        {
+            u32 id;
+            u32 length;
+        };
+
+        ///Follows a MESSAGE kind byte, then the encoded arguments, or the message text if format_id is 0
+        struct message_record
+        {
+            u64 timestamp;
+            u32 thread_id;
+            u32 tag_id;
+            u32 type_id;
+            u32 format_id; //string_hash of the arguments' signature
+            u32 length;
+        };
+    }
+
+    ///Appends log messages to a memory mapped file of a fixed size.
+    ///When the file fills up it's renamed to path.1 (path.1 to path.2 and so on) and a new one is started, keeping at most max_rotated_files old files.
+    class binary_log_writer
+    {
+    public:
+        [[nodiscard]] bool open(const std::filesystem::path& path, u64 max_file_size, u32 max_rotated_files);
+
+        ///Truncates the file to what has been written and closes it
+        void close();
+
+        [[nodiscard]] bool is_open() const;
+
+        ///Writes arguments encoded as described by signature, or message text if signature is empty.
+        ///Text too large for a file is clipped, but arguments can't be, so returns false if they were dropped.
+        bool write(u64 timestamp, u32 thread_id, std::string_view tag_id, std::string_view type, std::string_view signature, std::string_view payload);
+
+        ///Asks the OS to start writing what's been logged so far to disk
+        void flush() const;
+
+    private:
+        bool start_file();
+        void rotate();
+        void append(const void* data, u64 size);
+        void append_string(u32 id, std::string_view text);
+
+        mapped_file file;
+        std::filesystem::path path;
+        u64 max_file_size = 0;
+        u32 max_rotated_files = 0;
+        u64 offset = 0;
+        std::unordered_set<u32> written_strings; //Strings already in the current file
+    };
+
+    ///Log sink writing every message to a binary log file. See open_binary_log.
+    class binary_log_sink final : public log_sink
+    {
+    public:
+        [[nodiscard]] bool open(const std::filesystem::path& path, u64 max_file_size, u32 max_rotated_files);
+        void close();
+
+        void write(std::span<const log_message> messages) override;
+
+        [[nodiscard]] bool needs_text() const override { return false; }
+
+    private:
+        ///Signature with OPAQUE arguments stored as strings, for descriptors that have any
+        const std::string& get_stored_signature(const log_format_descriptor& descriptor);
+        ///Writes a message whose arguments don't fit in a file as text, which the writer clips
+        void write_clipped(const log_message& message);
+
+        binary_log_writer writer;
+        std::unordered_map<const log_format_descriptor*, std::string> stored_signatures;
+        std::string converted_arguments;
+    };
+
+    ///Message read back from a binary log. The strings point into the mapped file, so stay valid until the reader is closed,
+    ///except for message, which is formatted from the arguments and stays valid until the next call to next().
+    struct binary_log_entry
+    {
+        u64 timestamp;
+        u32 thread_id;
+        std::string_view tag_id;
+        std::string_view type;
+        std::string_view message;
+        std::string_view signature; //log_argument_codes of the arguments, empty for messages logged as text
+        std::span<const std::byte> arguments;
+    };
+
+    ///Reads messages back from a file written by binary_log_writer
+    class binary_log_reader
+    {
+    public:
+        [[nodiscard]] bool open(const std::filesystem::path& path);
+
+        ///Returns false at the end of the log, or where a truncated record is found
+        [[nodiscard]] bool next(binary_log_entry& entry_out);
+
+        [[nodiscard]] u64 start_timestamp() const;
+
+    private:
+        bool read(void* data_out, u64 size);
+
+        mapped_file file;
+        u64 offset = 0;
+        u64 file_start_timestamp = 0;
+        std::unordered_map<u32, std::string_view> strings;
+        std::string formatted_message;
+    };
+}
@@ -1,11 +1,15 @@
 #include "file_io.hpp"
 
+#include <deque>
 #include <filesystem>
 #include <fstream>
+#include <mutex>
 #include <regex>
 #include <string>
+#include <unordered_map>
 #include <tracy/Tracy.hpp>
 
+#include "asset_archive.hpp"
 #include "logger.hpp"
 #include "../common/common.hpp"
 #include "stblib/stb_image.hpp"
@@ -43,6 +47,22 @@ namespace hyengine
     static std::string root_directory = "assets";
     static std::string override_directory;
 
+    ///Interned asset ID with its cached resolution
+    struct asset_registry_entry
+    {
+        std::string id;
+        resolved_asset resolved;
+        u32 generation = 0; //The resolution is stale unless this matches asset_cache_generation
+    };
+
+    static std::mutex asset_registry_lock;
+    static std::deque<asset_registry_entry> asset_entries; //Never shrinks, so IDs and handles stay valid
+    static std::unordered_map<std::string_view, u32> asset_handles; //Keys point into asset_entries
+    static u32 asset_cache_generation = 1;
+
+    static std::mutex archives_lock;
+    static std::vector<std::shared_ptr<const asset_archive>> mounted_archives; //Most recently mounted last
+
     std::regex directive_data_pattern(const std::string_view& directive)
     {
         const std::string pattern = stringify("<", directive, "=([^>]+)>");
@@ -58,11 +78,13 @@ namespace hyengine
     void set_primary_asset_directory(const std::string_view& directory)
     {
         root_directory = directory;
+        invalidate_asset_cache();
     }
 
     void set_override_asset_directory(const std::string_view& directory)
     {
         override_directory = directory;
+        invalidate_asset_cache();
     }
 
     std::string_view get_primary_asset_directory()
@@ -75,18 +97,153 @@ namespace hyengine
         return override_directory.empty() ? root_directory : override_directory;
     }
 
-    std::filesystem::path get_asset_path(const std::string_view& asset_id)
+    bool mount_asset_archive(const std::filesystem::path& path)
+    {
+        ZoneScoped;
+        const std::shared_ptr<asset_archive> archive = std::make_shared<asset_archive>();
+        if (!archive->open(path))
+        {
+            log_error(logger_tags::FILEIO, "Couldn't mount asset archive '", path.string(), "'");
+            return false;
+        }
+
+        log_info(logger_tags::FILEIO, "Mounted asset archive '", path.string(), "' with ", archive->get_entry_count(), " assets");
+
+        archives_lock.lock();
+        mounted_archives.push_back(archive);
+        archives_lock.unlock();
+
+        invalidate_asset_cache();
+        return true;
+    }
+
+    void unmount_asset_archives()
+    {
+        archives_lock.lock();
+        mounted_archives.clear();
+        archives_lock.unlock();
+
+        //Stale cached resolutions would otherwise keep the archives mapped
+        asset_registry_lock.lock();
+        for (asset_registry_entry& entry : asset_entries)
+        {
+            entry.resolved.archive = nullptr;
+        }
+        asset_cache_generation++;
+        asset_registry_lock.unlock();
+    }
+
+    static bool find_archived_asset(const std::string_view& asset_id, resolved_asset& resolved_out)
+    {
+        archives_lock.lock();
+        for (auto archive = mounted_archives.rbegin(); archive != mounted_archives.rend(); ++archive)
+        {
+            if ((*archive)->find(asset_id, resolved_out.archived_bytes))
+            {
+                resolved_out.archive = *archive;
+                resolved_out.path = (*archive)->get_path();
+                resolved_out.exists = true;
+                resolved_out.archived = true;
+                archives_lock.unlock();
+                return true;
+            }
+        }
+        archives_lock.unlock();
+        return false;
+    }
+
+    static resolved_asset resolve_asset_uncached(const std::string_view& asset_id)
     {
+        ZoneScoped;
         std::string relative_path = std::string(asset_id);
         string_replace(relative_path, '.', std::filesystem::path::preferred_separator);
         const std::string asset_type = get_asset_type(asset_id);
         const std::string_view extension = get_asset_extension(asset_type);
 
+        if (resolved_asset archived {.extension = extension}; find_archived_asset(asset_id, archived)) return archived;
+
         std::filesystem::path override_path = std::filesystem::path(get_override_asset_directory()).append(relative_path).replace_extension(extension);
-        if (std::filesystem::exists(override_path)) return override_path;
+        if (std::filesystem::exists(override_path))
+        {
+            return {.path = std::move(override_path), .extension = extension, .exists = true, .overridden = get_override_asset_directory() != get_primary_asset_directory()};
+        }
 
         std::filesystem::path primary_path = std::filesystem::path(get_primary_asset_directory()).append(relative_path).replace_extension(extension);
-        return primary_path;
+        const bool exists = std::filesystem::exists(primary_path);
+        return {.path = std::move(primary_path), .extension = extension, .exists = exists};
+    }
+
+    asset_handle intern_asset_id(const std::string_view& asset_id)
+    {
+        asset_registry_lock.lock();
+        const auto existing = asset_handles.find(asset_id);
+        if (existing != asset_handles.end())
+        {
+            const asset_handle handle = {existing->second};
+            asset_registry_lock.unlock();
+            return handle;
+        }
+
+        const u32 index = static_cast<u32>(asset_entries.size());
+        const asset_registry_entry& entry = asset_entries.emplace_back(std::string(asset_id));
+        asset_handles.emplace(entry.id, index);
+        asset_registry_lock.unlock();
+        return {index};
+    }
+
+    std::string_view get_asset_id(const asset_handle handle)
+    {
+        if (!handle.valid()) return {};
+
+        asset_registry_lock.lock();
+        const std::string_view id = asset_entries[handle.index].id;
+        asset_registry_lock.unlock();
+        return id;
+    }
+
+    resolved_asset resolve_asset(const asset_handle handle)
+    {
+        if (!handle.valid()) return {};
+
+        asset_registry_lock.lock();
+        asset_registry_entry& entry = asset_entries[handle.index];
+        if (entry.generation == asset_cache_generation)
+        {
+            resolved_asset resolved = entry.resolved;
+            asset_registry_lock.unlock();
+            return resolved;
+        }
+        const u32 generation = asset_cache_generation;
+        asset_registry_lock.unlock();
+
+        //Resolve without holding the lock, as it hits the filesystem
+        resolved_asset resolved = resolve_asset_uncached(entry.id);
+
+        asset_registry_lock.lock();
+        if (generation == asset_cache_generation)
+        {
+            entry.resolved = resolved;
+            entry.generation = generation;
+        }
+        asset_registry_lock.unlock();
+        return resolved;
+    }
+
+    resolved_asset resolve_asset(const std::string_view& asset_id)
+    {
+        return resolve_asset(intern_asset_id(asset_id));
+    }
+
+    void invalidate_asset_cache()
+    {
+        asset_registry_lock.lock();
+        asset_cache_generation++;
+        asset_registry_lock.unlock();
+    }
+
+    std::filesystem::path get_asset_path(const std::string_view& asset_id)
+    {
+        return resolve_asset(asset_id).path;
     }
 
     std::filesystem::path get_asset_directory(const std::string_view& asset_id)
@@ -122,19 +279,28 @@ namespace hyengine
 
     bool asset_exists(const std::string_view& asset_id)
     {
-        return std::filesystem::exists(get_asset_path(asset_id));
+        return resolve_asset(asset_id).exists;
     }
 
     bool is_asset_overriden(const std::string_view& asset_id)
     {
-        const std::string asset_root = get_asset_path(asset_id).begin()->string();
-        const std::string_view expected_root = get_primary_asset_directory();
-        return asset_root != expected_root;
+        return resolve_asset(asset_id).overridden;
+    }
+
+    ///Archived assets resolve to their archive, which must never be written over or deleted through an asset ID
+    static bool is_asset_archived(const std::string_view& asset_id, const std::string_view& action)
+    {
+        if (!resolve_asset(asset_id).archived) return false;
+
+        log_error(logger_tags::FILEIO, "Couldn't ", action, " asset \'", asset_id, "\' - it's in a mounted asset archive");
+        return true;
     }
 
     void delete_asset(const std::string_view& asset_id)
     {
         ZoneScoped;
+        if (is_asset_archived(asset_id, "delete")) return;
+
         const std::filesystem::path path = get_asset_path(asset_id);
         if (!std::filesystem::exists(path))
         {
@@ -144,11 +310,14 @@ namespace hyengine
 
         log_info(logger_tags::FILEIO, "Deleting asset at \'", path.string(), "\'");
         std::filesystem::remove_all(path);
+        invalidate_asset_cache();
     }
 
     void delete_asset_directory(const std::string_view& asset_id)
     {
         ZoneScoped;
+        if (is_asset_archived(asset_id, "delete the directory of")) return;
+
         const std::filesystem::path directory = get_asset_directory(asset_id);
         if (!std::filesystem::exists(directory))
         {
@@ -158,12 +327,14 @@ namespace hyengine
 
         log_info(logger_tags::FILEIO, "Deleting directory at \'", directory.string(), "\'");
         std::filesystem::remove_all(directory);
+        invalidate_asset_cache();
     }
 
     std::string load_asset_text_raw(const std::string_view& id)
     {
         ZoneScoped;
-        if (!asset_exists(id))
+        const resolved_asset asset = resolve_asset(id);
+        if (!asset.exists)
         {
             log_error(logger_tags::FILEIO, "Could not read asset \'", id, "\' !");
             return "";
@@ -171,13 +342,15 @@ namespace hyengine
 
         log_debug(logger_tags::FILEIO, "Loading asset \'", id, "\'");
 
-        const std::filesystem::path path = get_asset_path(id);
+        const std::filesystem::path& path = asset.path;
 
-        if (is_asset_overriden(id))
+        if (asset.overridden)
         {
             log_debug(logger_tags::FILEIO, "Asset is overriden to '", path.string(), "'");
         }
 
+        if (asset.archived) return std::string(reinterpret_cast<const char*>(asset.archived_bytes.data()), asset.archived_bytes.size());
+
         std::ifstream file(path, std::ios::in);
 
         if (!file.is_open() || file.bad())
@@ -199,10 +372,11 @@ namespace hyengine
         return inject_text_includes(text);
     }
 
-    std::vector<u8> load_asset_bytes(const std::string_view& id)
+    asset_view view_asset(const std::string_view& id)
     {
         ZoneScoped;
-        if (!asset_exists(id))
+        const resolved_asset asset = resolve_asset(id);
+        if (!asset.exists)
         {
             log_error(logger_tags::FILEIO, "Could not read asset \'", id, "\' !");
             return {};
@@ -210,49 +384,45 @@ namespace hyengine
 
         log_debug(logger_tags::FILEIO, "Loading asset \'", id, "\'");
 
-        const std::filesystem::path path = get_asset_path(id);
+        const std::filesystem::path& path = asset.path;
 
-        if (is_asset_overriden(id))
+        if (asset.overridden)
         {
             log_debug(logger_tags::FILEIO, "Asset is overriden to '", path.string(), "'");
         }
 
-        std::ifstream file(path, std::ios::binary | std::ios::in);
+        if (asset.archived) return asset_view(asset.archive, asset.archived_bytes);
 
-        if (!file.is_open() || file.bad())
+        mapped_file file;
+        if (!file.open_read(path))
         {
             log_error(logger_tags::FILEIO, "Couldn't load asset \'", id, "\' - bad file");
             return {};
         }
 
-        file.unsetf(std::ios::skipws);
-
-        file.seekg(0, std::ios::end);
-        const std::streampos size = file.tellg();
-        file.seekg(0, std::ios::beg);
-
-        std::vector<u8> data;
-        data.reserve(size);
-        data.insert(data.begin(), std::istream_iterator<u8>(file), std::istream_iterator<u8>());
-
-        file.close();
-
-        return data;
+        return asset_view(std::move(file));
     }
 
+    std::vector<u8> load_asset_bytes(const std::string_view& id)
+    {
+        ZoneScoped;
+        const asset_view view = view_asset(id);
+        return std::vector<u8>(view.data(), view.data() + view.size());
+    }
 
     asset_image_data load_asset_image(const std::string_view& id)
     {
         ZoneScoped;
-        if (!asset_exists(id))
+        const resolved_asset asset = resolve_asset(id);
+        if (!asset.exists)
         {
             log_error(logger_tags::FILEIO, "Could not read asset \'", id, "\' !");
             return {nullptr, 0, 0, 0};
         }
 
-        const std::filesystem::path path = get_asset_path(id);
+        const std::filesystem::path& path = asset.path;
 
-        if (is_asset_overriden(id))
+        if (asset.overridden)
         {
             log_debug(logger_tags::FILEIO, "Asset is overriden to '", path.string(), "'");
         }
@@ -264,9 +434,14 @@ namespace hyengine
         i32 temp_height;
         i32 temp_channels;
 
-        stbi_set_unpremultiply_on_load(true);
-        stbi_set_flip_vertically_on_load(true);
-        result.data = stbi_load(path.string().c_str(), &temp_width, &temp_height, &temp_channels, 0);
+        //Per thread, as images may be decoded on several asset IO jobs at once
+        stbi_set_unpremultiply_on_load_thread(true);
+        stbi_set_flip_vertically_on_load_thread(true);
+        if (asset.archived)
+        {
+            result.data = stbi_load_from_memory(asset.archived_bytes.data(), static_cast<i32>(asset.archived_bytes.size()), &temp_width, &temp_height, &temp_channels, 0);
+        }
+        else result.data = stbi_load(path.string().c_str(), &temp_width, &temp_height, &temp_channels, 0);
         if (result.data == nullptr)
         {
             log_error(logger_tags::FILEIO, "Couldn't load asset \'", id, "\' - bad file");
@@ -282,6 +457,8 @@ namespace hyengine
     bool save_raw_asset(const std::string_view& id, const u8* data, const u32 size)
     {
         ZoneScoped;
+        if (is_asset_archived(id, "save")) return false;
+
         const std::filesystem::path directory = get_asset_directory(id);
         const std::filesystem::path path = get_asset_path(id);
 
@@ -302,6 +479,7 @@ namespace hyengine
 
         file.write(reinterpret_cast<const char8*>(data), size);
         file.close();
+        invalidate_asset_cache();
 
         return true;
     }
@@ -309,6 +487,8 @@ namespace hyengine
     bool save_asset_text(const std::string_view& id, const std::string_view& text)
     {
         ZoneScoped;
+        if (is_asset_archived(id, "save")) return false;
+
         const std::filesystem::path directory = get_asset_directory(id);
         const std::filesystem::path path = get_asset_path(id);
 
@@ -329,10 +509,28 @@ namespace hyengine
 
         file.write(text.data(), text.size());
         file.close();
+        invalidate_asset_cache();
 
         return true;
     }
 
+    void rotate_files(const std::filesystem::path& path, const u32 max_rotated_files)
+    {
+        const auto rotated_path = [&path](const u32 index)
+        {
+            std::filesystem::path result = path;
+            result += "." + std::to_string(index);
+            return result;
+        };
+
+        std::error_code error;
+        for (u32 index = max_rotated_files; index > 0; index--)
+        {
+            const std::filesystem::path source = index == 1 ? path : rotated_path(index - 1);
+            if (std::filesystem::exists(source, error)) std::filesystem::rename(source, rotated_path(index), error);
+        }
+    }
+
     std::string inject_text_includes(const std::string_view& text)
     {
         ZoneScoped;
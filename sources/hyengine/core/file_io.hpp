@@ -1,12 +1,18 @@
 #pragma once
+#include <cstring>
 #include <filesystem>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
+#include "mapped_file.hpp"
 #include "hyengine/common/sized_numerics.hpp"
 
 namespace hyengine
 {
+    class asset_archive;
+
     struct asset_image_data
     {
         u8* data; //RGBA ordered, with the number of channels included as specified below. 8-bit channels
@@ -15,6 +21,33 @@ namespace hyengine
         u32 num_channels;
     };
 
+    ///Read-only view of an asset's bytes, memory mapped rather than copied. The file stays mapped until the view is destroyed.
+    ///Don't truncate or rewrite the file while a view of it is alive, including by saving the same asset, which rewrites it in place.
+    ///On POSIX, touching a page past the file's new end raises SIGBUS, and in-place writes show through the view.
+    ///Renaming a new file over it is safe on POSIX, as the view keeps the old file's contents.
+    class asset_view
+    {
+    public:
+        asset_view() = default;
+        explicit asset_view(mapped_file&& file) : file(std::move(file)), view(reinterpret_cast<const u8*>(this->file.data()), this->file.size()), is_valid(true) {}
+
+        ///View of bytes within a mapping kept alive by owner, e.g. an asset in a mounted archive
+        asset_view(std::shared_ptr<const void> owner, const std::span<const u8> bytes) : owner(std::move(owner)), view(bytes), is_valid(true) {}
+
+        [[nodiscard]] const u8* data() const { return view.data(); }
+        [[nodiscard]] u64 size() const { return view.size(); }
+        [[nodiscard]] std::span<const u8> bytes() const { return view; }
+
+        ///False if the asset couldn't be found or mapped. An empty file is still a valid view.
+        [[nodiscard]] bool valid() const { return is_valid; }
+
+    private:
+        mapped_file file;
+        std::shared_ptr<const void> owner;
+        std::span<const u8> view;
+        bool is_valid = false;
+    };
+
     ///Sets the primary directory (relative path) that the engine will look for assets in. Defaults to 'assets'
     void set_primary_asset_directory(const std::string_view& directory);
 
@@ -25,6 +58,48 @@ namespace hyengine
     [[nodiscard]] std::string_view get_primary_asset_directory();
     [[nodiscard]] std::string_view get_override_asset_directory();
 
+    ///Interned asset ID. Compact, compares in constant time, and stays valid for the life of the program.
+    struct asset_handle
+    {
+        u32 index = UINT32_MAX;
+
+        [[nodiscard]] bool valid() const { return index != UINT32_MAX; }
+        bool operator==(const asset_handle&) const = default;
+    };
+
+    ///Where an asset ID resolves to on disk
+    struct resolved_asset
+    {
+        std::filesystem::path path {}; //For archived assets, the archive file
+        std::string_view extension {};
+        bool exists = false;
+        bool overridden = false; //Found in the override directory rather than the primary one
+        bool archived = false; //Found in a mounted asset archive rather than as a loose file
+        std::shared_ptr<const asset_archive> archive {}; //Keeps archived_bytes mapped
+        std::span<const u8> archived_bytes {};
+    };
+
+    ///Mounts a packed asset archive (see asset_archive and the hyengine-asset-packer tool).
+    ///Archives are searched before the override and primary directories, most recently mounted first.
+    ///Archived assets can't be saved or deleted while mounted, as the archive would keep shadowing any loose file.
+    bool mount_asset_archive(const std::filesystem::path& path);
+
+    ///Unmounts every archive. Views of assets in them stay valid until destroyed.
+    void unmount_asset_archives();
+
+    ///Interns an asset ID, so it can be resolved with a single hash lookup. The same ID always gives the same handle.
+    [[nodiscard]] asset_handle intern_asset_id(const std::string_view& asset_id);
+
+    [[nodiscard]] std::string_view get_asset_id(asset_handle handle);
+
+    ///Resolves an asset's path, extension, existence and override status. Cached until the asset directories change, an asset is saved or deleted,
+    ///or the cache is invalidated.
+    [[nodiscard]] resolved_asset resolve_asset(asset_handle handle);
+    [[nodiscard]] resolved_asset resolve_asset(const std::string_view& asset_id);
+
+    ///Forgets every cached resolution. Call after asset files are added or removed outside the engine.
+    void invalidate_asset_cache();
+
     ///Locates an asset based on ID. IDs are in the form ....'folder.type.name' where there may be any number of folders prior to the type and name.
     ///The type is ALSO an additional folder in the path, which is used to infer the asset type. For instance, 'assets.scene.shader.tree' is
     ///expected to be in the directory 'assets/scene/shader/' and will be inferred to be called 'tree.glsl' based on the type (last directory name) being 'shader'
@@ -56,6 +131,9 @@ namespace hyengine
     ///Loads an asset as text, and runs include processing on it (automatic replacement of <include=assetid> with the contents of assetid. Note that the FULL LINE containing the directive is overwritten)
     [[nodiscard]] std::string load_asset_text(const std::string_view& id);
 
+    ///Maps an asset into memory without copying it. Prefer this over load_asset_bytes when the bytes only need to be read.
+    [[nodiscard]] asset_view view_asset(const std::string_view& id);
+
     ///Loads an asset as bytes
     [[nodiscard]] std::vector<u8> load_asset_bytes(const std::string_view& id);
 
@@ -66,10 +144,10 @@ namespace hyengine
     template <typename data>
     [[nodiscard]] data load_asset_struct(const std::string_view& id, const data default_result)
     {
-        const std::vector<u8> bytes = load_asset_bytes(id);
+        const asset_view view = view_asset(id);
         data result;
-        if (bytes.size() != sizeof(data)) return default_result;
-        memcpy(&result, bytes.data(), sizeof(data));
+        if (view.size() != sizeof(data)) return default_result;
+        std::memcpy(&result, view.data(), sizeof(data));
         return result;
     }
 
@@ -86,6 +164,9 @@ namespace hyengine
         return save_raw_asset(id, &value, sizeof(data));
     }
 
+    ///Moves a file to path.1, path.1 to path.2 and so on, keeping at most max_rotated_files old files. Used to rotate log files.
+    void rotate_files(const std::filesystem::path& path, u32 max_rotated_files);
+
     ///Performs automatic replacement of <include=assetid> with the contents of assetid. Note that the FULL LINE containing the directive is overwritten)
     [[nodiscard]] std::string inject_text_includes(const std::string_view& text);
 
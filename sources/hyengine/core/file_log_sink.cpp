@@ -0,0 +1,123 @@
+#include "file_log_sink.hpp"
+
+#include <cstdio>
+#include <ctime>
+#include <tracy/Tracy.hpp>
+
+#include "file_io.hpp"
+
+namespace hyengine
+{
+    file_log_sink::file_log_sink(const std::filesystem::path& path, const u64 max_file_size, const u32 max_rotated_files, const u64 max_pending_bytes) :
+        path(path), max_file_size(max_file_size), max_rotated_files(max_rotated_files), max_pending_bytes(max_pending_bytes), task(*this)
+    {
+        task.set_priority(task_priority::BACKGROUND);
+
+        //Keep whatever the last run logged rather than overwriting it
+        rotate_files(path, max_rotated_files);
+        open_file();
+    }
+
+    file_log_sink::~file_log_sink()
+    {
+        if (task_started) task.await_completed();
+
+        writing.swap(pending);
+        write_batch();
+    }
+
+    void file_log_sink::write(const std::span<const log_message> messages)
+    {
+        ZoneScoped;
+        for (const log_message& message : messages)
+        {
+            if (pending.size() >= max_pending_bytes)
+            {
+                dropped_count++;
+                unreported_drops++;
+                continue;
+            }
+
+            if (unreported_drops > 0)
+            {
+                pending += "[" + std::to_string(unreported_drops) + " log messages dropped]\n";
+                unreported_drops = 0;
+            }
+
+            const std::time_t second = static_cast<std::time_t>(message.timestamp / 1000000000);
+            if (second != cached_second)
+            {
+                // ReSharper disable once CppDeprecatedEntity
+                const auto& time = std::localtime(&second);
+                char time_text[16];
+                std::snprintf(time_text, sizeof(time_text), "%02d:%02d:%02d", time->tm_hour, time->tm_min, time->tm_sec);
+                cached_time = time_text;
+                cached_second = second;
+            }
+
+            char prefix[32];
+            std::snprintf(prefix, sizeof(prefix), ".%03u][T%03u]", static_cast<u32>(message.timestamp / 1000000 % 1000), message.thread_id);
+
+            pending += '[';
+            pending += cached_time;
+            pending += prefix;
+            if (!message.type.empty()) pending.append("[").append(message.type).append("]");
+            if (!message.tag_id.empty()) pending.append("[").append(message.tag_id).append("]");
+            pending += ' ';
+            pending += message.message;
+            pending += '\n';
+        }
+
+        //Hand everything batched so far to the write task, unless the last write is still going - it'll be picked up next flush
+        if (pending.empty() || (task_started && !task.completed())) return;
+
+        writing.swap(pending);
+        if (task_started) task.reset();
+        task_started = true;
+        task.enqueue();
+    }
+
+    u64 file_log_sink::get_dropped_count() const
+    {
+        return dropped_count;
+    }
+
+    void file_log_sink::write_task::execute()
+    {
+        ZoneScopedN("Write log file");
+        sink.write_batch();
+    }
+
+    void file_log_sink::write_batch()
+    {
+        if (writing.empty()) return;
+
+        if (file_size > 0 && file_size + writing.size() > max_file_size)
+        {
+            file.close();
+            rotate_files(path, max_rotated_files);
+            open_file();
+        }
+
+        if (file.is_open())
+        {
+            file.write(writing.data(), static_cast<std::streamsize>(writing.size()));
+            file.flush();
+            file_size += writing.size();
+        }
+
+        writing.clear(); //Keeps its capacity, to be swapped back in for the next batch
+    }
+
+    bool file_log_sink::open_file()
+    {
+        file.open(path, std::ios::binary | std::ios::out | std::ios::trunc);
+        file_size = 0;
+        if (!file.is_open())
+        {
+            log_error(logger_tags::FILEIO, "Couldn't open log file \'", path.string(), "\'");
+            return false;
+        }
+        return true;
+    }
+}
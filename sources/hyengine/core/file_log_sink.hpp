@@ -0,0 +1,65 @@
+#pragma once
+#include <ctime>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "logger.hpp"
+#include "../threading/threading.hpp"
+
+namespace hyengine
+{
+    ///Log sink writing plain text to a file without blocking the flush task.
+    ///Messages are formatted into a batch, and a background task writes everything batched so far with a single write, one task at a time.
+    ///Once the file exceeds max_file_size it's moved to path.1 (path.1 to path.2 and so on), keeping at most max_rotated_files old files.
+    ///If the disk falls behind by more than max_pending_bytes, new messages are dropped and counted rather than stalling the flush task.
+    class file_log_sink final : public log_sink
+    {
+    public:
+        explicit file_log_sink(const std::filesystem::path& path, u64 max_file_size = 16 * 1024 * 1024, u32 max_rotated_files = 4, u64 max_pending_bytes = 8 * 1024 * 1024);
+
+        ///Waits for the write in flight and writes out anything still batched. Remove the sink from the logger first.
+        ~file_log_sink() override;
+
+        void write(std::span<const log_message> messages) override;
+
+        ///Messages dropped because the disk couldn't keep up
+        [[nodiscard]] u64 get_dropped_count() const;
+
+    private:
+        class write_task final : public threadpool_task
+        {
+        public:
+            explicit write_task(file_log_sink& sink) : sink(sink) {}
+
+        protected:
+            void execute() override;
+
+        private:
+            file_log_sink& sink;
+        };
+
+        ///Writes the batch handed to the write task, rotating first if it would overflow the file
+        void write_batch();
+        bool open_file();
+
+        std::filesystem::path path;
+        u64 max_file_size;
+        u32 max_rotated_files;
+        u64 max_pending_bytes;
+
+        //Only touched by the flush task
+        std::string pending;
+        u64 dropped_count = 0;
+        u64 unreported_drops = 0;
+        std::time_t cached_second = -1;
+        std::string cached_time; //"hh:mm:ss" for cached_second
+
+        //Handed over to the write task while it isn't running
+        std::string writing;
+        std::ofstream file;
+        u64 file_size = 0;
+        write_task task;
+        bool task_started = false;
+    };
+}
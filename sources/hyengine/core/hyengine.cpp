@@ -7,6 +7,8 @@
 
 #include "logger.hpp"
 #include "../input/input.hpp"
+#include "../threading/task_graph.hpp"
+#include "../threading/threading.hpp"
 #include "pcg/pcg_random.hpp"
 #include "tracy/TracyOpenGL.hpp"
 
@@ -105,16 +107,20 @@ namespace hyengine
 
             if (delta_time > max_frame_time)
             {
-                log_warn(logger_tags::ENGINE, "Last frame took too long! ", stringify_secs(delta_time), ", but max allowed is ", stringify_secs(max_frame_time));
+                HYENGINE_LOG_RATE_LIMITED(2, log_warn, logger_tags::ENGINE, "Last frame took too long! ", stringify_secs(delta_time), ", but max allowed is ", stringify_secs(max_frame_time));
                 delta_time = max_frame_time;
             }
 
             update_accumulator += delta_time;
+            const bool update_due = update_accumulator >= update_step_time;
             while (update_accumulator >= update_step_time && update_budget > 0)
             {
                 ZoneScopedNC("Update", 0xFF0077);
                 FrameMarkStart("Update");
+                task_graph* update_graph = config.update_graph; //The update callback may swap the graph out
+                if (update_graph != nullptr) update_graph->launch();
                 config.update(loop_data);
+                if (update_graph != nullptr) update_graph->await_completed();
                 FrameMarkEnd("Update");
 
                 if (config.should_exit) return;
@@ -125,7 +131,16 @@ namespace hyengine
             }
 
             if (should_render) frame_accumulator += delta_time;
-            if (frame_accumulator >= min_frame_time && should_render)
+            const bool render_due = frame_accumulator >= min_frame_time && should_render;
+
+            //Once per frame, rather than every spin of the loop - before rendering, so GL work handed over by workers lands in this frame
+            if (render_due || (update_due && !should_render))
+            {
+                process_main_thread_tasks(config.main_thread_task_budget);
+                plot_threadpool_stats();
+            }
+
+            if (render_due)
             {
                 FrameMarkStart("Render");
                 ZoneScopedNC("Render", 0x0077FF);
@@ -6,6 +6,8 @@
 
 namespace hyengine
 {
+    class task_graph;
+
     native_window* initialize_graphics(const window_config& main_window_config);
 
     namespace frame_loop
@@ -42,6 +44,13 @@ namespace hyengine
             ///If the engine is behind on updates (an update or render took a long time), it will run at most this many updates per frame to try and catch back up.
             u32 max_updates_per_frame = 5;
 
+            ///Max time, in seconds, spent each frame running tasks queued for the main thread (e.g. GL uploads handed over from workers).
+            f64 main_thread_task_budget = 0.002;
+
+            ///Compiled task graph launched at the start of every update and awaited once the update callback returns,
+            ///so the update callback runs alongside it and the main thread helps finish it. Not owned by the frame loop.
+            task_graph* update_graph = nullptr;
+
             ///Whether the rendering callback should be called
             bool should_render = true;
 
@@ -1,12 +1,18 @@
 #include "logger.hpp"
 
+#include <algorithm>
+#include <array>
 #include <chrono>
+#include <cstring>
 #include <ctime>
 #include <iomanip>
 #include <iostream>
+#include <memory>
 #include <mutex>
+#include <optional>
 #include <tracy/Tracy.hpp>
 
+#include "binary_log.hpp"
 #include "../threading/threading.hpp"
 #include "hyengine/common/common.hpp"
 
@@ -14,62 +20,295 @@ namespace hyengine
 {
     using namespace hyengine;
 
-    class logging_flush_task final : public threadpool_task
+    ///Fixed part of a record in a thread's log buffer. The tag, type and color strings follow it, then the message text or encoded arguments.
+    struct log_record_header
+    {
+        u64 timestamp;
+        const log_format_descriptor* descriptor; //Formats the encoded arguments in place of the message text, if set
+        u32 size; //Whole record including strings and padding. Zero marks padding up to the end of the buffer.
+        u32 thread_id;
+        u32 message_length;
+        u16 tag_id_length;
+        u16 tag_format_length;
+        u16 type_length;
+        u16 color_length;
+    };
+
+    std::string format_arguments(const log_format_descriptor& descriptor, const std::byte* encoded_arguments)
+    {
+        std::stringstream output;
+        descriptor.format(output, encoded_arguments);
+        return output.str();
+    }
+
+    ///Lock-free byte ring each logging thread writes its records into, drained by the flush task.
+    ///Single producer (the owning thread) and single consumer (the flush task). Records are contiguous and never wrap.
+    class thread_log_buffer
     {
     public:
-        std::vector<std::string> data;
+        static constexpr u64 CAPACITY = 64 * 1024;
+        static constexpr u64 RECORD_ALIGNMENT = 8;
 
-        void execute() override
+        ///Producer only. Writes either message text, or arguments encoded for a descriptor to format. Returns false if the record doesn't fit.
+        bool try_write(const u64 timestamp, const logger_tags::tag& tag, const std::string_view type, const std::string_view color_code,
+                       const log_format_descriptor* descriptor, const u64 message_size, const void* message)
         {
-            ZoneScopedN("Flush logs task");
-            constexpr std::string_view time_format = std::string_view("\u001B[36m\u001B[1m");
-            const std::time_t current_time = std::time(nullptr);
+            const u64 payload_size = tag.tag_id.size() + tag.message_format_codes.size() + type.size() + color_code.size() + message_size;
+            const u64 record_size = (sizeof(log_record_header) + payload_size + RECORD_ALIGNMENT - 1) & ~(RECORD_ALIGNMENT - 1);
 
-            // ReSharper disable once CppDeprecatedEntity
-            const auto& now = std::localtime(&current_time);
+            const u64 tail_index = tail.load(std::memory_order_relaxed);
+            const u64 offset = tail_index % CAPACITY;
+            const u64 space_to_end = CAPACITY - offset;
+            const u64 padding = space_to_end < record_size ? space_to_end : 0; //Skip to the start rather than split the record
+            if (padding + record_size > CAPACITY - (tail_index - head.load(std::memory_order_acquire))) return false;
+
+            if (padding > 0 && padding >= sizeof(log_record_header))
+            {
+                log_record_header padding_header {};
+                std::memcpy(&bytes[offset], &padding_header, sizeof(log_record_header));
+            }
+
+            std::byte* record = &bytes[(tail_index + padding) % CAPACITY];
+            const log_record_header header {
+                timestamp, descriptor, static_cast<u32>(record_size), thread_id, static_cast<u32>(message_size),
+                static_cast<u16>(tag.tag_id.size()), static_cast<u16>(tag.message_format_codes.size()), static_cast<u16>(type.size()), static_cast<u16>(color_code.size())
+            };
+            std::memcpy(record, &header, sizeof(log_record_header));
+
+            std::byte* payload = record + sizeof(log_record_header);
+            for (const std::string_view string : {std::string_view(tag.tag_id), std::string_view(tag.message_format_codes), type, color_code})
+            {
+                std::memcpy(payload, string.data(), string.size());
+                payload += string.size();
+            }
+
+            std::memcpy(payload, message, message_size);
+
+            tail.store(tail_index + padding + record_size, std::memory_order_release);
+            return true;
+        }
 
-            const std::string timestamp = stringify('[', time_format, now->tm_hour, ":", now->tm_min, ":", now->tm_sec, ansi_codes::ANSI_RESET, "]");
-            for (const std::string& message : data)
+        ///Consumer only. Copies every published record out and frees its space.
+        void drain(std::vector<log_message>& messages_out)
+        {
+            u64 head_index = head.load(std::memory_order_relaxed);
+            const u64 tail_index = tail.load(std::memory_order_acquire);
+            while (head_index != tail_index)
             {
-                if (message != ansi_codes::ANSI_DELETE_LINE) std::cout << timestamp;
-                std::cout << message;
+                const u64 offset = head_index % CAPACITY;
+                const u64 space_to_end = CAPACITY - offset;
+
+                log_record_header header {};
+                if (space_to_end >= sizeof(log_record_header)) std::memcpy(&header, &bytes[offset], sizeof(log_record_header));
+                if (header.size == 0) //Padding - the record continues at the start of the buffer
+                {
+                    head_index += space_to_end;
+                    continue;
+                }
+
+                const char* payload = reinterpret_cast<const char*>(&bytes[offset + sizeof(log_record_header)]);
+                auto read_string = [&payload](const u64 length) {
+                    std::string string(payload, length);
+                    payload += length;
+                    return string;
+                };
+
+                log_message& entry = messages_out.emplace_back();
+                entry.timestamp = header.timestamp;
+                entry.thread_id = header.thread_id;
+                entry.tag_id = read_string(header.tag_id_length);
+                entry.tag_format_codes = read_string(header.tag_format_length);
+                entry.type = read_string(header.type_length);
+                entry.color_code = read_string(header.color_length);
+                //Formatted later, and only if a sink needs the text
+                entry.descriptor = header.descriptor;
+                if (header.descriptor != nullptr) entry.encoded_arguments = read_string(header.message_length);
+                else entry.message = read_string(header.message_length);
+
+                head_index += header.size;
             }
+
+            head.store(head_index, std::memory_order_release);
         }
+
+        u32 thread_id = 0;
+
+        ///Owning thread's scratch for encoding log arguments
+        log_encode_buffer encode_buffer;
+
+        ///Cleared when the owning thread exits, so another thread can take the buffer over
+        atomic_bool in_use = true;
+
+    private:
+        alignas(64) std::atomic<u64> head = 0;
+        alignas(64) std::atomic<u64> tail = 0;
+        alignas(64) std::array<std::byte, CAPACITY> bytes;
     };
 
+    class logging_flush_task final : public threadpool_task
+    {
+    public:
+        void execute() override;
+    };
+
+    //Only used to keep one flush task in flight at a time - logging itself doesn't lock
     static std::mutex logging_lock;
     #ifdef DEBUG
-    static log_level logging_level = log_level::ALL;
+    static std::atomic<log_level> logging_level = log_level::ALL;
     #else
-    static log_level logging_level = log_level::NORMAL;
+    static std::atomic<log_level> logging_level = log_level::NORMAL;
     #endif
 
-    static i32 log_repeat_count = 0;
-    static std::string last_message;
-    static logger_tags::tag last_tag = {"None", ""};
-    static std::stringstream builder;
-    static std::vector<std::string> message_queue;
-    static bool has_buffered_messages = false;
-
+    static atomic_bool has_buffered_messages = false;
     static logging_flush_task* current_flush_task = nullptr;
 
+    static std::mutex log_buffers_lock; //Guards the list of buffers, taken once per thread
+    static std::vector<std::unique_ptr<thread_log_buffer>> log_buffers;
+
+    //Records too big for (or that didn't fit in) a thread's buffer, or logged by an exiting thread, go here instead, so nothing is dropped
+    static std::mutex overflow_lock;
+    static std::vector<log_message> overflow_messages;
+
+    ///Writes messages to stdout with ANSI colors, replacing repeats of the previous message with a count
+    class console_log_sink final : public log_sink
+    {
+    public:
+        void write(std::span<const log_message> messages) override;
+
+    private:
+        void write_message(std::ostream& output, const log_message& message);
+
+        i32 log_repeat_count = 0;
+        std::string last_message;
+        std::string last_tag_id = "None";
+    };
+
+    //Taken by the flush task while writing to the sinks
+    static std::mutex log_sinks_lock;
+    static console_log_sink console_sink;
+    static std::vector<log_sink*> log_sinks = {&console_sink};
+    static binary_log_sink binary_sink;
+
+    //Rate limiters that have suppressed something, checked on each flush. Call site statics, so never removed.
+    static std::mutex rate_limits_lock;
+    static std::vector<log_rate_limit*> rate_limits;
+
+    //Trivially destructible, so they stay usable by thread-local destructors that log after the owner below has been destroyed
+    static thread_local thread_log_buffer* current_log_buffer = nullptr;
+    static thread_local u32 current_log_thread_id = 0;
+    static thread_local bool log_buffer_released = false;
+
+    ///Hands the thread's buffer back when the thread exits. Anything the thread logs afterwards takes the locked overflow path,
+    ///as another thread may already be writing to the buffer.
+    struct thread_log_buffer_owner
+    {
+        ~thread_log_buffer_owner()
+        {
+            log_buffer_released = true;
+            if (current_log_buffer == nullptr) return;
+
+            current_log_buffer->in_use.store(false, std::memory_order_release);
+            current_log_buffer = nullptr;
+        }
+    };
+
+    ///The calling thread's buffer, or nullptr once the thread has handed it back on exit
+    thread_log_buffer* get_thread_log_buffer()
+    {
+        if (current_log_buffer != nullptr || log_buffer_released) return current_log_buffer;
+
+        static thread_local thread_log_buffer_owner owner;
+        current_log_thread_id = get_current_thread_id();
+
+        log_buffers_lock.lock();
+        for (const std::unique_ptr<thread_log_buffer>& buffer : log_buffers)
+        {
+            if (!buffer->in_use.load(std::memory_order_acquire))
+            {
+                current_log_buffer = buffer.get();
+                break;
+            }
+        }
+        if (current_log_buffer == nullptr) current_log_buffer = log_buffers.emplace_back(std::make_unique<thread_log_buffer>()).get();
+        current_log_buffer->in_use.store(true, std::memory_order_relaxed);
+        current_log_buffer->thread_id = current_log_thread_id;
+        log_buffers_lock.unlock();
+
+        return current_log_buffer;
+    }
+
     void set_log_level(const log_level level)
     {
-        logging_lock.lock();
-        logging_level = level;
-        logging_lock.unlock();
+        logging_level.store(level, std::memory_order_relaxed);
     }
 
-    void flush_logs()
+    log_level get_log_level()
     {
-        ZoneScoped;
-        logging_lock.lock();
+        return logging_level.load(std::memory_order_relaxed);
+    }
+
+    void log_rate_limit::register_log_rate_limit(log_rate_limit* limit)
+    {
+        rate_limits_lock.lock();
+        rate_limits.push_back(limit);
+        rate_limits_lock.unlock();
+    }
+
+    ///Drains every thread's buffer and the overflow list, and hands the messages to the sinks in timestamp order
+    static void write_buffered_logs()
+    {
+        std::vector<log_message> messages;
 
-        if (!has_buffered_messages)
+        log_buffers_lock.lock();
+        for (const std::unique_ptr<thread_log_buffer>& buffer : log_buffers)
         {
-            logging_lock.unlock();
-            return;
+            buffer->drain(messages);
         }
+        log_buffers_lock.unlock();
+
+        overflow_lock.lock();
+        std::move(overflow_messages.begin(), overflow_messages.end(), std::back_inserter(messages));
+        overflow_messages.clear();
+        overflow_lock.unlock();
+
+        if (messages.empty()) return;
+
+        //Each thread's records are already in order, merge them into one timeline
+        std::stable_sort(messages.begin(), messages.end(), [](const log_message& lhs, const log_message& rhs) { return lhs.timestamp < rhs.timestamp; });
+
+        log_sinks_lock.lock();
+        if (std::ranges::any_of(log_sinks, [](const log_sink* sink) { return sink->needs_text(); }))
+        {
+            for (log_message& message : messages)
+            {
+                if (message.descriptor != nullptr) message.message = format_arguments(*message.descriptor, reinterpret_cast<const std::byte*>(message.encoded_arguments.data()));
+            }
+        }
+        for (log_sink* sink : log_sinks)
+        {
+            sink->write(messages);
+        }
+        log_sinks_lock.unlock();
+    }
+
+    static void report_rate_limits()
+    {
+        rate_limits_lock.lock();
+        for (log_rate_limit* limit : rate_limits)
+        {
+            limit->report_expired();
+        }
+        rate_limits_lock.unlock();
+    }
+
+    void flush_logs()
+    {
+        ZoneScoped;
+        report_rate_limits();
+
+        if (!has_buffered_messages.load(std::memory_order_relaxed)) return;
+
+        logging_lock.lock();
 
         if (current_flush_task != nullptr && !current_flush_task->completed())
         {
@@ -77,101 +316,173 @@ namespace hyengine
             return;
         }
 
-        delete current_flush_task;
-        current_flush_task = nullptr;
+        has_buffered_messages = false;
 
+        delete current_flush_task;
         current_flush_task = new logging_flush_task();
-        current_flush_task->data = message_queue;
+        current_flush_task->set_priority(task_priority::BACKGROUND);
         current_flush_task->enqueue();
 
-        message_queue.clear();
-        has_buffered_messages = false;
-
         logging_lock.unlock();
     }
 
-    inline void write_tag(const std::string_view format, const std::string_view color_code, const logger_tags::tag& tag)
+    void flush_logs_now()
     {
-        builder << '[' << format << color_code << tag.tag_id << ansi_codes::ANSI_RESET << ']' << tag.message_format_codes;
+        ZoneScoped;
+        report_rate_limits();
+
+        //Holding the lock keeps flush_logs from starting another task, so the sinks only ever see one writer
+        logging_lock.lock();
+        if (current_flush_task != nullptr) current_flush_task->await_completed();
+        has_buffered_messages = false;
+        write_buffered_logs();
+        logging_lock.unlock();
     }
 
-    inline void write_repeat_tag(const std::string_view color_code)
+    inline void write_tag(std::ostream& output, const std::string_view format, const std::string_view color_code, const std::string_view tag_id, const std::string_view tag_format_codes)
     {
-        builder << ansi_codes::ANSI_RESET << " [" << ansi_codes::ANSI_BOLD << color_code << "+" << std::to_string(log_repeat_count) << ansi_codes::ANSI_RESET << ']';
+        output << '[' << format << color_code << tag_id << ansi_codes::ANSI_RESET << ']' << tag_format_codes;
     }
 
-    void log(const logger_tags::tag& tag, const std::string_view msg, const std::string_view type, const std::string_view color_code)
+    inline void write_repeat_tag(std::ostream& output, const std::string_view color_code, const i32 repeat_count)
     {
-        ZoneScoped;
-
-        logging_lock.lock();
+        output << ansi_codes::ANSI_RESET << " [" << ansi_codes::ANSI_BOLD << color_code << "+" << std::to_string(repeat_count) << ansi_codes::ANSI_RESET << ']';
+    }
 
-        const bool is_repeat = msg == last_message && tag.tag_id == last_tag.tag_id;
+    void console_log_sink::write(const std::span<const log_message> messages)
+    {
+        std::stringstream output;
+        for (const log_message& message : messages)
+        {
+            write_message(output, message);
+        }
+        std::cout << output.str();
+    }
 
+    void console_log_sink::write_message(std::ostream& output, const log_message& entry)
+    {
+        const bool is_repeat = entry.message == last_message && entry.tag_id == last_tag_id;
         if (is_repeat)
         {
             log_repeat_count++;
-            message_queue.emplace_back(ansi_codes::ANSI_DELETE_LINE);
+            output << ansi_codes::ANSI_DELETE_LINE;
         }
         else
         {
             log_repeat_count = 0;
-            last_message = msg;
-            last_tag = tag;
+            last_message = entry.message;
+            last_tag_id = entry.tag_id;
         }
 
-        builder << stringify("[", ansi_codes::ANSI_BOLD, ansi_codes::ANSI_BRIGHT_BLUE, "T", std::setfill('0'), std::setw(3), get_current_thread_id(), ansi_codes::ANSI_RESET, ']');
+        constexpr std::string_view time_format = std::string_view("\u001B[36m\u001B[1m");
+        const std::time_t entry_time = static_cast<std::time_t>(entry.timestamp / 1000000000);
 
-        if (!type.empty()) write_tag(ansi_codes::ANSI_BOLD, color_code, {type, ""});
-        if (!tag.tag_id.empty()) write_tag(ansi_codes::ANSI_RESET, ansi_codes::ANSI_PURPLE, tag);
+        // ReSharper disable once CppDeprecatedEntity
+        const auto& time = std::localtime(&entry_time);
 
-        builder << ' ' << color_code << msg << ansi_codes::ANSI_RESET;
+        output << '[' << time_format << time->tm_hour << ":" << time->tm_min << ":" << time->tm_sec << ansi_codes::ANSI_RESET << "]";
+        output << '[' << ansi_codes::ANSI_BOLD << ansi_codes::ANSI_BRIGHT_BLUE << 'T' << std::setfill('0') << std::setw(3) << entry.thread_id << ansi_codes::ANSI_RESET << ']';
 
-        if (is_repeat) write_repeat_tag(color_code);
+        if (!entry.type.empty()) write_tag(output, ansi_codes::ANSI_BOLD, entry.color_code, entry.type, "");
+        if (!entry.tag_id.empty()) write_tag(output, ansi_codes::ANSI_RESET, ansi_codes::ANSI_PURPLE, entry.tag_id, entry.tag_format_codes);
 
-        builder << '\n';
+        output << ' ' << entry.color_code << entry.message << ansi_codes::ANSI_RESET;
 
-        message_queue.push_back(builder.str());
-        builder.str("");
+        if (is_repeat) write_repeat_tag(output, entry.color_code, log_repeat_count);
 
-        has_buffered_messages = true;
+        output << '\n';
+    }
 
-        logging_lock.unlock();
+    void logging_flush_task::execute()
+    {
+        ZoneScopedN("Flush logs task");
+        write_buffered_logs();
     }
 
-    void log_debug(const logger_tags::tag& tag, const std::string_view msg)
+    void add_log_sink(log_sink* sink)
     {
-        if (logging_level > log_level::NORMAL) log(tag, msg, "DEBG", ansi_codes::ANSI_LIME);
+        log_sinks_lock.lock();
+        if (std::find(log_sinks.begin(), log_sinks.end(), sink) == log_sinks.end()) log_sinks.push_back(sink);
+        log_sinks_lock.unlock();
     }
 
-    void log_info(const logger_tags::tag& tag, const std::string_view msg)
+    void remove_log_sink(log_sink* sink)
     {
-        if (logging_level > log_level::REDUCED) log(tag, msg, "INFO", ansi_codes::ANSI_AZURE);
+        log_sinks_lock.lock();
+        std::erase(log_sinks, sink);
+        log_sinks_lock.unlock();
     }
 
-    void log_performance(const logger_tags::tag& tag, const std::string_view msg)
+    log_sink* get_console_log_sink()
     {
-        if (logging_level > log_level::REDUCED) log(tag, msg, "PERF", ansi_codes::ANSI_CYAN);
+        return &console_sink;
     }
 
-    void log_warn(const logger_tags::tag& tag, const std::string_view msg)
+    bool open_binary_log(const std::filesystem::path& path, const u64 max_file_size, const u32 max_rotated_files)
     {
-        if (logging_level > log_level::NONE) log(tag, msg, "WARN", ansi_codes::ANSI_BRIGHT_YELLOW);
+        log_sinks_lock.lock();
+        const bool opened = binary_sink.open(path, max_file_size, max_rotated_files);
+        if (opened && std::find(log_sinks.begin(), log_sinks.end(), &binary_sink) == log_sinks.end()) log_sinks.push_back(&binary_sink);
+        log_sinks_lock.unlock();
+
+        if (!opened) log_error(logger_tags::FILEIO, "Failed to open binary log '", path.string(), "'");
+        return opened;
     }
 
-    void log_error(const logger_tags::tag& tag, const std::string_view msg)
+    void close_binary_log()
     {
-        if (logging_level > log_level::NONE) log(tag, msg, "ERRR", ansi_codes::ANSI_RED);
+        log_sinks_lock.lock();
+        std::erase(log_sinks, &binary_sink);
+        binary_sink.close();
+        log_sinks_lock.unlock();
     }
 
-    void log_fatal(const logger_tags::tag& tag, const std::string_view msg)
+    u64 log_timestamp()
     {
-        constexpr std::string_view fatal_format = std::string_view("\u001B[91m\u001B[1m\u001B[4m");
-        log(tag, msg, "FATAL", fatal_format);
+        return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count());
     }
 
-    void log_secret(const logger_tags::tag& tag, const std::string_view msg)
+    void log_overflow(const u64 timestamp, const u32 thread_id, const logger_tags::tag& tag, const std::string_view type, const std::string_view color_code, std::string message)
     {
-        log(tag, msg, "SECRET", ansi_codes::ANSI_BRIGHT_YELLOW);
+        overflow_lock.lock();
+        overflow_messages.push_back({timestamp, thread_id, std::string(tag.tag_id), std::string(tag.message_format_codes), std::string(type), std::string(color_code), std::move(message)});
+        overflow_lock.unlock();
+    }
+
+    void log(const logger_tags::tag& tag, const std::string_view msg, const std::string_view type, const std::string_view color_code)
+    {
+        ZoneScoped;
+        const u64 timestamp = log_timestamp();
+
+        thread_log_buffer* buffer = get_thread_log_buffer();
+        if (buffer == nullptr || !buffer->try_write(timestamp, tag, type, color_code, nullptr, msg.size(), msg.data())) log_overflow(timestamp, current_log_thread_id, tag, type, color_code, std::string(msg));
+
+        has_buffered_messages.store(true, std::memory_order_relaxed);
+    }
+
+    void log_deferred(const logger_tags::tag& tag, const log_format_descriptor& descriptor, const void* arguments, const std::string_view type, const std::string_view color_code)
+    {
+        ZoneScoped;
+        const u64 timestamp = log_timestamp();
+        thread_log_buffer* buffer = get_thread_log_buffer();
+
+        //An exiting thread has handed its buffer back, scratch and all, so encodes into its own
+        std::optional<log_encode_buffer> exiting_thread_encode_buffer;
+        log_encode_buffer& encode_buffer = buffer != nullptr ? buffer->encode_buffer : exiting_thread_encode_buffer.emplace();
+
+        //Starts past anything already there if an argument logs while being formatted, and leaves that untouched
+        const u64 start = encode_buffer.bytes.size();
+        descriptor.encode(encode_buffer, arguments);
+        const std::byte* encoded_arguments = reinterpret_cast<const std::byte*>(encode_buffer.bytes.data() + start);
+        const u64 encoded_size = encode_buffer.bytes.size() - start;
+
+        if (buffer == nullptr || !buffer->try_write(timestamp, tag, type, color_code, &descriptor, encoded_size, encoded_arguments))
+        {
+            //Too big for the buffer, or the thread is exiting - format it here instead
+            log_overflow(timestamp, current_log_thread_id, tag, type, color_code, format_arguments(descriptor, encoded_arguments));
+        }
+        encode_buffer.bytes.resize(start);
+
+        has_buffered_messages.store(true, std::memory_order_relaxed);
     }
 }
@@ -1,4 +1,20 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <new>
+#include <ostream>
+#include <span>
+#include <streambuf>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+
 #include "../common/common.hpp"
 
 #include "../common/sized_numerics.hpp"
@@ -60,53 +76,476 @@ namespace hyengine
         constexpr std::string_view ANSI_GREY = "\u001B[37m";
         constexpr std::string_view ANSI_WHITE = "\u001B[97m";
         constexpr std::string_view ANSI_DELETE_LINE = "\u001B[1A\u001B[2K\r";
+        constexpr std::string_view ANSI_FATAL = "\u001B[91m\u001B[1m\u001B[4m";
 
     }
 
+    #ifndef HYENGINE_COMPILED_LOG_LEVEL
+    #if defined(DEBUG) || !defined(NDEBUG)
+    #define HYENGINE_COMPILED_LOG_LEVEL ALL
+    #else
+    #define HYENGINE_COMPILED_LOG_LEVEL NORMAL
+    #endif
+    #endif
+
+    #ifndef HYENGINE_STRIPPED_LOG_TAGS
+    #define HYENGINE_STRIPPED_LOG_TAGS ""
+    #endif
+
+    ///Most verbose log level compiled in. Log calls above it compile to nothing, whatever the runtime log level is set to.
+    ///Set with the HYENGINE_COMPILED_LOG_LEVEL define (ALL, NORMAL, REDUCED or NONE). Defaults to ALL in debug builds and NORMAL otherwise.
+    constexpr log_level COMPILED_LOG_LEVEL = log_level::HYENGINE_COMPILED_LOG_LEVEL;
+
     namespace logger_tags
     {
         struct tag
         {
-            tag(const std::string_view& tag, const std::string_view& format_codes) noexcept : tag_id(tag), message_format_codes(format_codes) {}
+            constexpr tag(const std::string_view& tag, const std::string_view& format_codes) noexcept : id(string_hash(tag)), tag_id(tag), message_format_codes(format_codes) {}
 
-            std::string tag_id;
-            std::string message_format_codes;
+            ///Hash of the tag name
+            u32 id;
+            std::string_view tag_id;
+            std::string_view message_format_codes;
         };
 
         //General tags
 
-        const tag ENGINE = {"Hyengine", ""};
-        const tag FILEIO = {"FileIO", ""};
-        const tag GRAPHICS = {"Graphics", ""};
-        const tag INPUT = {"Input", ""};
-        const tag ASYNC = {"Async", ""};
-        const tag DEBUG = {"Debug", ""};
+        constexpr tag ENGINE = {"Hyengine", ""};
+        constexpr tag FILEIO = {"FileIO", ""};
+        constexpr tag GRAPHICS = {"Graphics", ""};
+        constexpr tag INPUT = {"Input", ""};
+        constexpr tag ASYNC = {"Async", ""};
+        constexpr tag DEBUG = {"Debug", ""};
+
+        constexpr std::string_view STRIPPED_TAG_NAMES = HYENGINE_STRIPPED_LOG_TAGS;
+        constexpr size_t STRIPPED_TAG_COUNT = STRIPPED_TAG_NAMES.empty() ? 0 : std::ranges::count(STRIPPED_TAG_NAMES, ',') + 1;
+
+        ///IDs of the tags listed in the HYENGINE_STRIPPED_LOG_TAGS define (comma separated tag names, e.g. "Input,Async")
+        constexpr std::array<u32, STRIPPED_TAG_COUNT> STRIPPED_TAG_IDS = [] {
+            std::array<u32, STRIPPED_TAG_COUNT> ids {};
+            size_t start = 0;
+            for (u32& id : ids)
+            {
+                const size_t end = std::min(STRIPPED_TAG_NAMES.find(',', start), STRIPPED_TAG_NAMES.size());
+                id = string_hash(STRIPPED_TAG_NAMES.substr(start, end - start));
+                start = end + 1;
+            }
+            return ids;
+        }();
+
+        ///False for stripped tags. For the constant tags above this folds away, so log calls using a stripped tag compile to nothing.
+        constexpr bool is_compiled(const tag& tag)
+        {
+            for (const u32 id : STRIPPED_TAG_IDS)
+            {
+                if (id == tag.id) return false;
+            }
+            return true;
+        }
     }
 
     void set_log_level(const log_level level);
+    [[nodiscard]] log_level get_log_level();
 
-    ///Triggers an async log writing task to be executed. Must be called for logs to be output.
+    ///Triggers an async task that drains every thread's log buffer and hands the messages to each log sink in timestamp order.
+    ///Called periodically by the threadpool (see threadpool_config::log_flush_interval), or call it directly to flush sooner.
     void flush_logs();
 
+    ///Drains every buffer and writes it to the sinks on the calling thread, after any flush already in flight. For tools that run without a
+    ///threadpool, so their errors are seen before they exit.
+    void flush_logs_now();
+
+    struct log_format_descriptor;
+
+    ///Log message as handed to sinks. Messages logged with arguments keep them encoded alongside the formatted text.
+    struct log_message
+    {
+        u64 timestamp; //Nanoseconds since the epoch
+        u32 thread_id;
+        std::string tag_id;
+        std::string tag_format_codes;
+        std::string type;
+        std::string color_code;
+        std::string message; //Left empty for messages with a descriptor when no sink needs_text
+        const log_format_descriptor* descriptor = nullptr; //Set if the message was logged as encoded_arguments rather than text
+        std::string encoded_arguments {};
+    };
+
+    ///Destination for flushed log messages. Called from the flush task with each batch of messages in timestamp order, never concurrently.
+    class log_sink
+    {
+    public:
+        virtual ~log_sink() = default;
+
+        virtual void write(std::span<const log_message> messages) = 0;
+
+        ///Sinks that only read descriptor and encoded_arguments return false, so messages aren't formatted unless another sink needs the text
+        [[nodiscard]] virtual bool needs_text() const { return true; }
+    };
+
+    ///Starts sending flushed messages to the sink. The caller keeps ownership.
+    void add_log_sink(log_sink* sink);
+
+    ///Stops sending messages to the sink. Once this returns the sink is no longer in use and can be destroyed. Don't call it from inside a sink.
+    void remove_log_sink(log_sink* sink);
+
+    ///The sink writing colored messages to stdout, added by default.
+    [[nodiscard]] log_sink* get_console_log_sink();
+
+    ///Also writes every flushed message to a compact binary file, so full logs can be kept without the cost of console output.
+    ///The file is memory mapped at max_file_size. When full it's moved to path.1 (path.1 to path.2 and so on), keeping at most max_rotated_files old files.
+    ///Render it as text with the hyengine-log-decoder tool.
+    bool open_binary_log(const std::filesystem::path& path, u64 max_file_size = 16 * 1024 * 1024, u32 max_rotated_files = 4);
+
+    ///Truncates the binary log to what has been written and closes it. Flush logs first to include anything still buffered.
+    void close_binary_log();
+
     void log(const logger_tags::tag& tag, const std::string_view msg, const std::string_view type, const std::string_view color_code);
-    void log_debug(const logger_tags::tag& tag, const std::string_view msg);
-    void log_info(const logger_tags::tag& tag, const std::string_view msg);
-    void log_performance(const logger_tags::tag& tag, const std::string_view msg);
-    void log_warn(const logger_tags::tag& tag, const std::string_view msg);
-    void log_error(const logger_tags::tag& tag, const std::string_view msg);
-    void log_fatal(const logger_tags::tag& tag, const std::string_view msg);
-    void log_secret(const logger_tags::tag& tag, const std::string_view msg);
 
+    ///Per-thread scratch a log call's arguments are encoded into before being copied into a log buffer.
+    ///Arguments formatted on the calling thread are streamed straight into it, so each is formatted once and steady-state logging doesn't allocate.
+    class log_encode_buffer final : std::streambuf
+    {
+    public:
+        log_encode_buffer() : stream(this) {}
+
+        log_encode_buffer(const log_encode_buffer&) = delete;
+        log_encode_buffer& operator=(const log_encode_buffer&) = delete;
+
+        void append(const void* data, const u64 size)
+        {
+            bytes.append(static_cast<const char*>(data), size);
+        }
+
+        ///Stream appending to bytes, formatting like stringify
+        std::ostream& get_stream()
+        {
+            stream.flags(std::ios::fixed);
+            stream.precision(2);
+            stream.width(0);
+            stream.fill(' ');
+            return stream;
+        }
+
+        std::string bytes;
+
+    private:
+        int_type overflow(const int_type character) override
+        {
+            if (!traits_type::eq_int_type(character, traits_type::eof())) bytes.push_back(traits_type::to_char_type(character));
+            return traits_type::not_eof(character);
+        }
+
+        std::streamsize xsputn(const char* characters, const std::streamsize count) override
+        {
+            bytes.append(characters, static_cast<size_t>(count));
+            return count;
+        }
+
+        std::ostream stream;
+    };
+
+    ///Self-contained value types that are copied into log buffers byte for byte and formatted on the flush task, like arithmetic types and enums.
+    ///Specialize it for other types that own all their data and can be printed to a std::ostream.
+    template <typename type>
+    struct is_log_value_type : std::false_type {};
+
+    #define LOG_VALUE_TYPE(type) template <> struct is_log_value_type<type> : std::true_type {};
+
+    LOG_VALUE_TYPE(glm::vec2)
+    LOG_VALUE_TYPE(glm::ivec2)
+    LOG_VALUE_TYPE(glm::dvec2)
+    LOG_VALUE_TYPE(glm::vec3)
+    LOG_VALUE_TYPE(glm::ivec3)
+    LOG_VALUE_TYPE(glm::dvec3)
+    LOG_VALUE_TYPE(glm::vec4)
+    LOG_VALUE_TYPE(glm::ivec4)
+    LOG_VALUE_TYPE(glm::dvec4)
+
+    #undef LOG_VALUE_TYPE
+
+    ///Types that only point at data owned elsewhere, which may be gone by the time the flush task formats the message
+    template <typename type>
+    struct is_log_view_type : std::bool_constant<std::is_pointer_v<type> && !std::is_function_v<std::remove_pointer_t<type>>> {};
+
+    template <typename element_type, size_t extent>
+    struct is_log_view_type<std::span<element_type, extent>> : std::true_type {};
+
+    template <typename char_type, typename traits_type>
+    struct is_log_view_type<std::basic_string_view<char_type, traits_type>> : std::true_type {};
 
-    #define VARARG_DEF(type) void type(const logger_tags::tag tag, const std::string_view first, const auto... rest) { type(tag, stringify(first, rest...)); }
+    ///Type of each encoded argument in a log_format_descriptor's signature, so binary logs can be formatted offline without the program's types.
+    ///OPAQUE arguments (enums, is_log_value_type types, stream manipulators) can only be formatted by their log_argument.
+    namespace log_argument_codes
+    {
+        constexpr char STRING = 's'; //u32 length, then the characters
+        constexpr char BOOL = 'b';
+        constexpr char CHAR = 'c';
+        constexpr char I16 = 'h';
+        constexpr char U16 = 'H';
+        constexpr char I32 = 'i';
+        constexpr char U32 = 'I';
+        constexpr char I64 = 'l';
+        constexpr char U64 = 'L';
+        constexpr char F32 = 'f';
+        constexpr char F64 = 'd';
+        constexpr char OPAQUE = '?';
+    }
+
+    ///Signature code for an argument copied into the log buffer byte for byte
+    template <typename type>
+    constexpr char log_argument_code()
+    {
+        using namespace log_argument_codes;
+        if constexpr (std::is_same_v<type, bool>) return BOOL;
+        else if constexpr (std::is_same_v<type, char> || std::is_same_v<type, signed char> || std::is_same_v<type, unsigned char>) return CHAR;
+        else if constexpr (std::is_integral_v<type> && sizeof(type) == 2) return std::is_signed_v<type> ? I16 : U16;
+        else if constexpr (std::is_integral_v<type> && sizeof(type) == 4) return std::is_signed_v<type> ? I32 : U32;
+        else if constexpr (std::is_integral_v<type> && sizeof(type) == 8) return std::is_signed_v<type> ? I64 : U64;
+        else if constexpr (std::is_same_v<type, float>) return F32;
+        else if constexpr (std::is_same_v<type, double>) return F64;
+        else return OPAQUE;
+    }
+
+    ///How a log argument is copied into a log buffer, and streamed back out as text on the flush task.
+    ///Arithmetic values, enums, function pointers (stream manipulators) and is_log_value_type types are copied as-is.
+    ///Strings are copied as a length and characters. Anything else is formatted on the calling thread, straight into the encode buffer.
+    ///Pointers and other views are rejected - they'd be dereferenced long after the call, so pass what they point at instead.
+    template <typename type>
+    struct log_argument;
+
+    template <>
+    struct log_argument<std::string_view>
+    {
+        static constexpr char code = log_argument_codes::STRING;
 
-    VARARG_DEF(log_debug)
-    VARARG_DEF(log_info)
-    VARARG_DEF(log_performance)
-    VARARG_DEF(log_warn)
-    VARARG_DEF(log_error)
-    VARARG_DEF(log_fatal)
-    VARARG_DEF(log_secret)
+        static void encode(log_encode_buffer& destination, const std::string_view& value)
+        {
+            const u32 length = static_cast<u32>(value.size());
+            destination.append(&length, sizeof(u32));
+            destination.append(value.data(), length);
+        }
+
+        static const std::byte* format(std::ostream& output, const std::byte* source)
+        {
+            u32 length;
+            std::memcpy(&length, source, sizeof(u32));
+            output << std::string_view(reinterpret_cast<const char*>(source + sizeof(u32)), length);
+            return source + sizeof(u32) + length;
+        }
+    };
+
+    template <>
+    struct log_argument<std::string> : log_argument<std::string_view> {};
+
+    template <>
+    struct log_argument<const char*>
+    {
+        static constexpr char code = log_argument_codes::STRING;
+
+        static void encode(log_encode_buffer& destination, const char* value)
+        {
+            log_argument<std::string_view>::encode(destination, value != nullptr ? value : "");
+        }
+
+        static const std::byte* format(std::ostream& output, const std::byte* source)
+        {
+            return log_argument<std::string_view>::format(output, source);
+        }
+    };
+
+    template <>
+    struct log_argument<char*> : log_argument<const char*> {};
+
+    template <typename type>
+    struct log_argument
+    {
+        static_assert(!is_log_view_type<type>::value, "Log arguments are formatted later on the flush task - log what the pointer or view refers to, not the view itself");
+
+        static constexpr bool copied_as_is = std::is_arithmetic_v<type> || std::is_enum_v<type> || std::is_pointer_v<type> || is_log_value_type<type>::value;
+        static constexpr char code = copied_as_is ? log_argument_code<type>() : log_argument_codes::STRING;
+
+        static void encode(log_encode_buffer& destination, const type& value)
+        {
+            if constexpr (copied_as_is) destination.append(&value, sizeof(type));
+            else
+            {
+                //Reserve the length, format the value in after it, then fill the length in
+                const u64 length_offset = destination.bytes.size();
+                destination.bytes.append(sizeof(u32), '\0');
+                destination.get_stream() << value;
+
+                const u32 length = static_cast<u32>(destination.bytes.size() - length_offset - sizeof(u32));
+                std::memcpy(destination.bytes.data() + length_offset, &length, sizeof(u32));
+            }
+        }
+
+        static const std::byte* format(std::ostream& output, const std::byte* source)
+        {
+            if constexpr (copied_as_is)
+            {
+                alignas(type) std::byte storage[sizeof(type)];
+                std::memcpy(storage, source, sizeof(type));
+                output << *std::launder(reinterpret_cast<const type*>(storage));
+                return source + sizeof(type);
+            }
+            else return log_argument<std::string_view>::format(output, source);
+        }
+    };
+
+    ///Streams one encoded argument as text, returning where the next argument starts
+    typedef const std::byte* (*log_argument_formatter)(std::ostream& output, const std::byte* source);
+
+    ///Static description of a log call's argument types, shared by every call with the same argument types.
+    ///Encodes the arguments on the logging thread, and formats them (like stringify) on the flush task.
+    struct log_format_descriptor
+    {
+        void (*encode)(log_encode_buffer& destination, const void* arguments);
+        void (*format)(std::ostream& output, const std::byte* encoded_arguments);
+
+        ///One log_argument_codes code per argument
+        std::string_view signature;
+        ///One formatter per argument, for formatting OPAQUE arguments on their own
+        const log_argument_formatter* argument_formatters;
+    };
+
+    template <typename... argument_types>
+    struct log_format
+    {
+        static void encode(log_encode_buffer& destination, const void* arguments)
+        {
+            const auto& values = *static_cast<const std::tuple<const argument_types&...>*>(arguments);
+            std::apply([&destination](const argument_types&... value) {
+                (log_argument<std::decay_t<argument_types>>::encode(destination, value), ...);
+            }, values);
+        }
+
+        static void format(std::ostream& output, const std::byte* encoded_arguments)
+        {
+            output << std::fixed << std::setprecision(2);
+            ((encoded_arguments = log_argument<std::decay_t<argument_types>>::format(output, encoded_arguments)), ...);
+        }
+
+        static constexpr std::array<char, sizeof...(argument_types)> signature = {log_argument<std::decay_t<argument_types>>::code...};
+        static constexpr std::array<log_argument_formatter, sizeof...(argument_types)> argument_formatters = {&log_argument<std::decay_t<argument_types>>::format...};
+        static constexpr log_format_descriptor descriptor = {&encode, &format, std::string_view(signature.data(), signature.size()), argument_formatters.data()};
+    };
+
+    ///Encodes a log message's arguments and copies them into the calling thread's log buffer, to be formatted when the logs are flushed.
+    void log_deferred(const logger_tags::tag& tag, const log_format_descriptor& descriptor, const void* arguments, std::string_view type, std::string_view color_code);
+
+    //Kept out of line, so the log_* wrappers stay small enough to inline and disabled calls fold away at the call site
+    #if defined(_MSC_VER)
+    #define HYENGINE_LOG_NOINLINE __declspec(noinline)
+    #else
+    #define HYENGINE_LOG_NOINLINE __attribute__((noinline))
+    #endif
+
+    template <typename... argument_types>
+    HYENGINE_LOG_NOINLINE void log_deferred(const logger_tags::tag& tag, const std::string_view type, const std::string_view color_code, const argument_types&... values)
+    {
+        const std::tuple<const argument_types&...> arguments(values...);
+        log_deferred(tag, log_format<argument_types...>::descriptor, &arguments, type, color_code);
+    }
+
+    //Calls above the compiled log level or with a stripped tag compile to nothing. Otherwise the runtime level is checked before anything is copied,
+    //and formatting is left to the flush task.
+    #define VARARG_DEF(type, level, type_name, color_code) inline void type(const logger_tags::tag& tag, const auto& first, const auto&... rest) \
+    { \
+        if constexpr (COMPILED_LOG_LEVEL >= level) \
+        { \
+            if (logger_tags::is_compiled(tag) && get_log_level() >= level) log_deferred(tag, type_name, color_code, first, rest...); \
+        } \
+    }
+
+    VARARG_DEF(log_debug, log_level::ALL, "DEBG", ansi_codes::ANSI_LIME)
+    VARARG_DEF(log_info, log_level::NORMAL, "INFO", ansi_codes::ANSI_AZURE)
+    VARARG_DEF(log_performance, log_level::NORMAL, "PERF", ansi_codes::ANSI_CYAN)
+    VARARG_DEF(log_warn, log_level::REDUCED, "WARN", ansi_codes::ANSI_BRIGHT_YELLOW)
+    VARARG_DEF(log_error, log_level::REDUCED, "ERRR", ansi_codes::ANSI_RED)
+    VARARG_DEF(log_fatal, log_level::NONE, "FATAL", ansi_codes::ANSI_FATAL)
+    VARARG_DEF(log_secret, log_level::NONE, "SECRET", ansi_codes::ANSI_BRIGHT_YELLOW)
 
     #undef VARARG_DEF
+
+    ///Rate limit for a single log call site. Lets up to max_per_second messages through each second, then only every sample_every'th one
+    ///(none if zero), counting the rest. Meant to be a static at the call site - see HYENGINE_LOG_RATE_LIMITED.
+    ///Counts are approximate when several threads log from the same call site at once.
+    class log_rate_limit
+    {
+    public:
+        ///Logs a summary of how many messages a limiter suppressed, when no later message from its call site reported them
+        using report_function = void (*)(u32 suppressed);
+
+        constexpr log_rate_limit(const u32 max_per_second, const u32 sample_every, const report_function report) noexcept
+            : max_per_second(max_per_second), sample_every(sample_every), report(report) {}
+
+        ///Returns true if the message should be logged, with how many messages were suppressed since the last one let through
+        bool try_acquire(u32& suppressed_out) noexcept
+        {
+            const i64 now = now_nanoseconds();
+
+            i64 start = window_start.load(std::memory_order_relaxed);
+            if (now - start >= WINDOW_LENGTH && window_start.compare_exchange_strong(start, now, std::memory_order_relaxed)) window_count.store(0, std::memory_order_relaxed);
+
+            const u32 count = window_count.fetch_add(1, std::memory_order_relaxed);
+            const bool sampled = sample_every > 0 && (count - max_per_second + 1) % sample_every == 0;
+            if (count >= max_per_second && !sampled)
+            {
+                suppressed.fetch_add(1, std::memory_order_relaxed);
+                if (!registered.exchange(true, std::memory_order_relaxed)) register_log_rate_limit(this);
+                return false;
+            }
+
+            suppressed_out = suppressed.exchange(0, std::memory_order_relaxed);
+            return true;
+        }
+
+        ///Reports the suppressed count once the window it was counted in has passed, so a burst that stops is still accounted for.
+        ///Called by flush_logs for every limiter that has suppressed something.
+        void report_expired() noexcept
+        {
+            if (suppressed.load(std::memory_order_relaxed) == 0 || now_nanoseconds() - window_start.load(std::memory_order_relaxed) < WINDOW_LENGTH) return;
+            if (const u32 count = suppressed.exchange(0, std::memory_order_relaxed); count > 0) report(count);
+        }
+
+    private:
+        static constexpr i64 WINDOW_LENGTH = 1000000000;
+
+        static i64 now_nanoseconds() noexcept
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+
+        ///Adds the limiter to the ones flush_logs checks, the first time it suppresses a message
+        static void register_log_rate_limit(log_rate_limit* limit);
+
+        const u32 max_per_second;
+        const u32 sample_every;
+        const report_function report;
+        std::atomic<i64> window_start = INT64_MIN / 2;
+        std::atomic<u32> window_count = 0;
+        std::atomic<u32> suppressed = 0;
+        std::atomic<bool> registered = false;
+    };
+
+    ///Logs through log_function (log_warn, log_info...) at most max_per_second times a second from this call site, then every sample_every'th
+    ///message after that. The rate is checked before any arguments are evaluated or formatted. The next message let through reports how many
+    ///were suppressed, or if none comes, flush_logs logs the count with the call site once the second is up.
+    ///e.g. HYENGINE_LOG_SAMPLED(5, 100, log_warn, logger_tags::ENGINE, "Slow frame: ", time)
+    #define HYENGINE_LOG_SAMPLED(max_per_second, sample_every, log_function, tag, ...) do { \
+        static ::hyengine::log_rate_limit hyengine_log_limit_(max_per_second, sample_every, [](const ::hyengine::u32 hyengine_suppressed_) \
+        { \
+            ::hyengine::log_function(tag, "[", hyengine_suppressed_, " similar suppressed from " __FILE__ ":", __LINE__, "]"); \
+        }); \
+        if (::hyengine::u32 hyengine_suppressed_ = 0; hyengine_log_limit_.try_acquire(hyengine_suppressed_)) \
+        { \
+            if (hyengine_suppressed_ > 0) ::hyengine::log_function(tag, __VA_ARGS__, " [", hyengine_suppressed_, " similar suppressed]"); \
+            else ::hyengine::log_function(tag, __VA_ARGS__); \
+        } \
+    } while (false)
+
+    ///Logs through log_function at most max_per_second times a second from this call site. See HYENGINE_LOG_SAMPLED.
+    #define HYENGINE_LOG_RATE_LIMITED(max_per_second, log_function, tag, ...) HYENGINE_LOG_SAMPLED(max_per_second, 0, log_function, tag, __VA_ARGS__)
+    #undef HYENGINE_LOG_NOINLINE
 }
@@ -0,0 +1,203 @@
+#include "mapped_file.hpp"
+
+#include <utility>
+
+#include "logger.hpp"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include "windows.h"
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace hyengine
+{
+    mapped_file::mapped_file(mapped_file&& other) noexcept
+    {
+        *this = std::move(other);
+    }
+
+    mapped_file& mapped_file::operator=(mapped_file&& other) noexcept
+    {
+        if (this == &other) return *this;
+        close();
+
+        mapping = std::exchange(other.mapping, nullptr);
+        mapped_size = std::exchange(other.mapped_size, 0);
+        writable = std::exchange(other.writable, false);
+        open = std::exchange(other.open, false);
+        #if defined(_WIN32)
+        file_handle = std::exchange(other.file_handle, nullptr);
+        mapping_handle = std::exchange(other.mapping_handle, nullptr);
+        #else
+        file_descriptor = std::exchange(other.file_descriptor, -1);
+        #endif
+        return *this;
+    }
+
+    mapped_file::~mapped_file()
+    {
+        close();
+    }
+
+    bool mapped_file::open_read(const std::filesystem::path& path)
+    {
+        close();
+        std::error_code error;
+        const u64 file_size = std::filesystem::file_size(path, error);
+        if (error)
+        {
+            log_error(logger_tags::FILEIO, "Failed to map '", path.string(), "' - ", error.message());
+            return false;
+        }
+
+        return map(path, file_size, false);
+    }
+
+    bool mapped_file::create(const std::filesystem::path& path, const u64 size)
+    {
+        close();
+        return map(path, size, true);
+    }
+
+    #if defined(_WIN32)
+
+    bool mapped_file::map(const std::filesystem::path& path, const u64 size, const bool writable)
+    {
+        const DWORD access = writable ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ;
+        const DWORD creation = writable ? CREATE_ALWAYS : OPEN_EXISTING;
+        //Share everything, like an fstream would, so the file can still be saved over, renamed or deleted while mapped
+        file_handle = CreateFileW(path.c_str(), access, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, creation, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file_handle == INVALID_HANDLE_VALUE)
+        {
+            file_handle = nullptr;
+            log_error(logger_tags::FILEIO, "Failed to open '", path.string(), "' for mapping");
+            return false;
+        }
+
+        this->writable = writable;
+        mapped_size = size;
+        open = true;
+        if (size == 0) return true; //Can't map an empty file, but there's nothing to view anyway
+
+        mapping_handle = CreateFileMappingW(file_handle, nullptr, writable ? PAGE_READWRITE : PAGE_READONLY, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+        if (mapping_handle != nullptr) mapping = static_cast<std::byte*>(MapViewOfFile(mapping_handle, writable ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, size));
+
+        if (mapping == nullptr)
+        {
+            log_error(logger_tags::FILEIO, "Failed to map '", path.string(), "'");
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void mapped_file::close(const u64 truncated_size)
+    {
+        if (!open) return;
+        if (mapping != nullptr) UnmapViewOfFile(mapping);
+        if (mapping_handle != nullptr) CloseHandle(mapping_handle);
+
+        if (writable && truncated_size < mapped_size)
+        {
+            LARGE_INTEGER position;
+            position.QuadPart = static_cast<LONGLONG>(truncated_size);
+            SetFilePointerEx(file_handle, position, nullptr, FILE_BEGIN);
+            SetEndOfFile(file_handle);
+        }
+
+        CloseHandle(file_handle);
+        mapping = nullptr;
+        mapping_handle = nullptr;
+        file_handle = nullptr;
+        mapped_size = 0;
+        open = false;
+    }
+
+    void mapped_file::flush_async() const
+    {
+        if (mapping != nullptr && writable) FlushViewOfFile(mapping, 0);
+    }
+
+    #else
+
+    bool mapped_file::map(const std::filesystem::path& path, const u64 size, const bool writable)
+    {
+        file_descriptor = writable ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644) : ::open(path.c_str(), O_RDONLY);
+        if (file_descriptor < 0)
+        {
+            log_error(logger_tags::FILEIO, "Failed to open '", path.string(), "' for mapping");
+            return false;
+        }
+
+        this->writable = writable;
+        mapped_size = size;
+        open = true;
+        if (size == 0) return true; //Can't map an empty file, but there's nothing to view anyway
+
+        if (writable && ftruncate(file_descriptor, static_cast<off_t>(size)) != 0)
+        {
+            log_error(logger_tags::FILEIO, "Failed to size '", path.string(), "' for mapping");
+            close();
+            return false;
+        }
+
+        void* address = mmap(nullptr, size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, file_descriptor, 0);
+        if (address == MAP_FAILED)
+        {
+            log_error(logger_tags::FILEIO, "Failed to map '", path.string(), "'");
+            close();
+            return false;
+        }
+
+        mapping = static_cast<std::byte*>(address);
+        return true;
+    }
+
+    void mapped_file::close(const u64 truncated_size)
+    {
+        if (!open) return;
+        if (mapping != nullptr) munmap(mapping, mapped_size);
+        if (writable && truncated_size < mapped_size && ftruncate(file_descriptor, static_cast<off_t>(truncated_size)) != 0)
+        {
+            log_warn(logger_tags::FILEIO, "Failed to truncate mapped file");
+        }
+
+        ::close(file_descriptor);
+        mapping = nullptr;
+        file_descriptor = -1;
+        mapped_size = 0;
+        open = false;
+    }
+
+    void mapped_file::flush_async() const
+    {
+        if (mapping != nullptr && writable) msync(mapping, mapped_size, MS_ASYNC);
+    }
+
+    #endif
+
+    bool mapped_file::is_open() const
+    {
+        return open;
+    }
+
+    std::byte* mapped_file::data()
+    {
+        return mapping;
+    }
+
+    const std::byte* mapped_file::data() const
+    {
+        return mapping;
+    }
+
+    u64 mapped_file::size() const
+    {
+        return mapped_size;
+    }
+}
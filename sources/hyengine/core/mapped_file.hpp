@@ -0,0 +1,51 @@
+#pragma once
+#include <filesystem>
+
+#include "hyengine/common/sized_numerics.hpp"
+
+namespace hyengine
+{
+    ///A file mapped into memory. Either a read-only view of an existing file, or a writable file created at a fixed size.
+    class mapped_file
+    {
+    public:
+        mapped_file() = default;
+        mapped_file(mapped_file&& other) noexcept;
+        mapped_file& operator=(mapped_file&& other) noexcept;
+        mapped_file(const mapped_file&) = delete;
+        mapped_file& operator=(const mapped_file&) = delete;
+        ~mapped_file();
+
+        ///Maps an existing file read-only. Empty files open successfully, with no data.
+        [[nodiscard]] bool open_read(const std::filesystem::path& path);
+
+        ///Creates (or replaces) a file of the given size, zero filled, and maps it for writing.
+        [[nodiscard]] bool create(const std::filesystem::path& path, u64 size);
+
+        ///Unmaps the file. A writable file can be truncated to the amount actually used.
+        void close(u64 truncated_size = UINT64_MAX);
+
+        ///Asks the OS to start writing modified pages back to disk. Doesn't wait for the write to finish.
+        void flush_async() const;
+
+        [[nodiscard]] bool is_open() const;
+        [[nodiscard]] std::byte* data();
+        [[nodiscard]] const std::byte* data() const;
+        [[nodiscard]] u64 size() const;
+
+    private:
+        bool map(const std::filesystem::path& path, u64 size, bool writable);
+
+        std::byte* mapping = nullptr;
+        u64 mapped_size = 0;
+        bool writable = false;
+        bool open = false;
+
+        #if defined(_WIN32)
+        void* file_handle = nullptr;
+        void* mapping_handle = nullptr;
+        #else
+        int file_descriptor = -1;
+        #endif
+    };
+}
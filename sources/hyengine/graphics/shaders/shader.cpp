@@ -1,6 +1,7 @@
 #include "shader.hpp"
 
 #include <array>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <sstream>
@@ -8,6 +9,7 @@
 #include <vector>
 #include <tracy/Tracy.hpp>
 
+#include "../../core/asset_archive.hpp"
 #include "../../core/file_io.hpp"
 #include "tracy/TracyOpenGL.hpp"
 
@@ -54,6 +56,7 @@ namespace hyengine
 
         program_id = 0;
         uniform_locations.clear();
+        missing_uniforms.clear();
         log_debug(logger_tags::GRAPHICS, "Unloaded shader '", asset_id, "'");
     }
 
@@ -295,7 +298,20 @@ namespace hyengine
 
     std::string shader::get_binary_asset_id(const std::string_view& normal_asset_id)
     {
-        return hyengine::stringify(binary_cache_directory, get_asset_name(normal_asset_id));
+        //The whole ID, flattened into one name, so shaders with the same name in different folders or archives don't share a cache
+        std::string cache_name = std::string(normal_asset_id);
+        string_replace(cache_name, '.', '_');
+        return hyengine::stringify(binary_cache_directory, cache_name);
+    }
+
+    u32 shader::get_source_hash(const std::string_view& asset_id)
+    {
+        //A cached binary is only valid for the source it was built from. Archived shaders share the archive's path, so also use its content hash,
+        //which changes whenever it's repacked.
+        const resolved_asset source = resolve_asset(asset_id);
+        std::string identity = hyengine::stringify(asset_id, '|', source.path.string());
+        if (source.archived) identity += hyengine::stringify('|', source.archive->get_content_hash());
+        return string_hash(identity);
     }
 
     GLuint shader::load_binary_program(const std::string_view& asset_id)
@@ -304,13 +320,14 @@ namespace hyengine
         TracyGpuZone("load shader binary");
         const std::string binary_asset_id = get_binary_asset_id(asset_id);
         if (!asset_exists(binary_asset_id)) return 0;
-        const std::vector<u8> binary_data = load_asset_bytes(binary_asset_id);
+        const asset_view binary_data = view_asset(binary_asset_id);
+        if (binary_data.size() < sizeof(binary_cache_header)) return 0;
 
-        const void* header_pointer = binary_data.data();
-        const void* data_pointer = static_cast<const u8*>(header_pointer) + sizeof(binary_cache_header);
-        const binary_cache_header header = *static_cast<const binary_cache_header*>(header_pointer);
+        const void* data_pointer = binary_data.data() + sizeof(binary_cache_header);
+        binary_cache_header header;
+        std::memcpy(&header, binary_data.data(), sizeof(binary_cache_header));
 
-        const u32 asset_hash = string_hash(get_asset_path(asset_id).string());
+        const u32 asset_hash = get_source_hash(asset_id);
         if (asset_hash != header.asset_hash) return 0;
 
         const GLuint program = glCreateProgram();
@@ -335,7 +352,7 @@ namespace hyengine
 
         GLint written_length = 0;
         GLenum written_format = 0;
-        const u32 asset_hash = string_hash(get_asset_path(asset_id).string());
+        const u32 asset_hash = get_source_hash(asset_id);
 
         glGetProgramBinary(program, buffer_size, &written_length, &written_format, static_cast<u8*>(pointer) + sizeof(binary_cache_header));
         static_cast<binary_cache_header*>(pointer)[0] = binary_cache_header {written_format, asset_hash };
@@ -464,7 +481,15 @@ namespace hyengine
         }
     }
 
-    #define TRY_SET_UNIFORM(setter) TracyGpuZone("set shader uniform"); if(const auto location = uniform_locations.find(std::string(name)); location != uniform_locations.end()) { setter; } else if(valid()) { log_warn(logger_tags::GRAPHICS, "Failed to set uniform '",  name, "'"); }
+    void shader::warn_missing_uniform(const std::string_view& name)
+    {
+        if (missing_uniforms.contains(name)) return;
+
+        missing_uniforms.emplace(name);
+        log_warn(logger_tags::GRAPHICS, "Failed to set uniform '", name, "' in shader '", asset_id, "', it doesn't exist or was optimized out");
+    }
+
+    #define TRY_SET_UNIFORM(setter) TracyGpuZone("set shader uniform"); if(const auto location = uniform_locations.find(name); location != uniform_locations.end()) { setter; } else if(valid()) { warn_missing_uniform(name); }
 
     void shader::set_uniform(const std::string_view& name, const bool value)
     {
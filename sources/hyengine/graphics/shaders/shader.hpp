@@ -1,7 +1,9 @@
 #pragma once
 
+#include <functional>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <tracy/Tracy.hpp>
 
@@ -75,7 +77,7 @@ namespace hyengine
         void set_sampler_slot(const std::string_view& name, i32 slot);
 
 
-        #define TRY_SET_UNIFORM(setter) if(const auto location = uniform_locations.find(std::string(name)); location != uniform_locations.end()) { setter; } else if(valid()) log_warn(logger_tags::GRAPHICS, "Failed to set uniform array '", name, "'");
+        #define TRY_SET_UNIFORM(setter) if(const auto location = uniform_locations.find(name); location != uniform_locations.end()) { setter; } else if(valid()) warn_missing_uniform(name);
 
         template <std::size_t size>
         void set_uniform(const std::string_view& name, std::array<bool, size> values)
@@ -245,15 +247,24 @@ namespace hyengine
         static GLuint load_program(const std::string_view& asset_id, const std::string_view& binary_asset_id);
         static GLuint link_program(const std::vector<GLuint>& shaders);
         static std::string get_binary_asset_id(const std::string_view& normal_asset_id);
+        static u32 get_source_hash(const std::string_view& asset_id);
         static GLuint load_binary_program(const std::string_view& asset_id);
         static void save_binary_program(const std::string_view& asset_id, const GLuint program);
         static bool update_line_type(const std::string_view line, i32* line_type);
 
         void load_interface_locations();
+        void warn_missing_uniform(const std::string_view& name);
 
         constexpr static std::string_view logger_tag = "Shader";
         constexpr static std::string_view binary_cache_directory = "store.cache.shader.bin.";
 
+        ///Lets uniform names be looked up by string_view, without building a std::string per call
+        struct uniform_name_hash
+        {
+            using is_transparent = void;
+            std::size_t operator()(const std::string_view name) const noexcept { return std::hash<std::string_view>{}(name); }
+        };
+
         struct block_location_and_binding
         {
             i32 location;
@@ -266,7 +277,9 @@ namespace hyengine
             u32 asset_hash;
         };
 
-        std::unordered_map<std::string, i32> uniform_locations;
+        std::unordered_map<std::string, i32, uniform_name_hash, std::equal_to<>> uniform_locations;
+        ///Uniforms that were set but don't exist, each warned about once per load
+        std::unordered_set<std::string, uniform_name_hash, std::equal_to<>> missing_uniforms;
         std::unordered_map<std::string, block_location_and_binding> storage_block_bindings;
         std::unordered_map<std::string, block_location_and_binding> uniform_block_bindings;
 
@@ -0,0 +1,112 @@
+#include "coroutines.hpp"
+
+#include <array>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <tracy/Tracy.hpp>
+
+namespace hyengine
+{
+    //Frames are bucketed into 64 byte size classes up to 4kb, anything larger goes straight to the heap
+    static constexpr size_t FRAME_SIZE_GRANULARITY = 64;
+    static constexpr size_t FRAME_SIZE_CLASS_COUNT = 64;
+    static constexpr size_t FRAMES_PER_BLOCK = 64;
+
+    struct free_frame
+    {
+        free_frame* next;
+    };
+
+    struct frame_size_class
+    {
+        std::mutex lock;
+        free_frame* free_frames = nullptr;
+        std::vector<std::unique_ptr<std::byte[]>> blocks;
+    };
+
+    static std::array<frame_size_class, FRAME_SIZE_CLASS_COUNT> frame_size_classes;
+
+    ///Resumes a coroutine on a worker thread. Detached and recycled through resume_task_pool once it has run.
+    class coroutine_resume_task final : public threadpool_task
+    {
+    public:
+        coroutine_resume_task(const std::coroutine_handle<> handle, const std::span<threadpool_task* const> dependencies) : threadpool_task(dependencies), handle(handle) {}
+
+    protected:
+        void execute() override
+        {
+            ZoneScopedN("Resume coroutine");
+            handle.resume();
+        }
+
+        void release_detached() override;
+
+    private:
+        std::coroutine_handle<> handle;
+    };
+
+    static threadpool_task_pool<coroutine_resume_task> resume_task_pool;
+
+    void coroutine_resume_task::release_detached()
+    {
+        resume_task_pool.release(this);
+    }
+
+    void* allocate_coroutine_frame(const size_t size)
+    {
+        const size_t size_class_index = (size + FRAME_SIZE_GRANULARITY - 1) / FRAME_SIZE_GRANULARITY - 1;
+        if (size_class_index >= FRAME_SIZE_CLASS_COUNT) return ::operator new(size);
+
+        frame_size_class& size_class = frame_size_classes[size_class_index];
+        size_class.lock.lock();
+        if (size_class.free_frames == nullptr)
+        {
+            const size_t frame_size = (size_class_index + 1) * FRAME_SIZE_GRANULARITY;
+            size_class.blocks.push_back(std::make_unique<std::byte[]>(frame_size * FRAMES_PER_BLOCK));
+            std::byte* block = size_class.blocks.back().get();
+            for (size_t i = 0; i < FRAMES_PER_BLOCK; i++)
+            {
+                free_frame* frame = reinterpret_cast<free_frame*>(block + i * frame_size);
+                frame->next = size_class.free_frames;
+                size_class.free_frames = frame;
+            }
+        }
+
+        free_frame* frame = size_class.free_frames;
+        size_class.free_frames = frame->next;
+        size_class.lock.unlock();
+        return frame;
+    }
+
+    void free_coroutine_frame(void* frame, const size_t size)
+    {
+        const size_t size_class_index = (size + FRAME_SIZE_GRANULARITY - 1) / FRAME_SIZE_GRANULARITY - 1;
+        if (size_class_index >= FRAME_SIZE_CLASS_COUNT)
+        {
+            ::operator delete(frame);
+            return;
+        }
+
+        frame_size_class& size_class = frame_size_classes[size_class_index];
+        free_frame* freed = static_cast<free_frame*>(frame);
+        size_class.lock.lock();
+        freed->next = size_class.free_frames;
+        size_class.free_frames = freed;
+        size_class.lock.unlock();
+    }
+
+    void resume_on_threadpool(const std::coroutine_handle<> handle, const std::span<threadpool_task* const> dependencies, const task_priority priority)
+    {
+        coroutine_resume_task* task = resume_task_pool.create(handle, dependencies);
+        task->set_priority(priority);
+        task->enqueue_detached();
+    }
+
+    void resume_on_main_thread(const std::coroutine_handle<> handle)
+    {
+        coroutine_resume_task* task = resume_task_pool.create(handle, std::span<threadpool_task* const>());
+        task->set_main_thread_affinity(true);
+        task->enqueue_detached();
+    }
+}
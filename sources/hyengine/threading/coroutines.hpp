@@ -0,0 +1,306 @@
+#pragma once
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <span>
+#include <thread>
+#include <utility>
+#include <tracy/Tracy.hpp>
+
+#include "threading.hpp"
+
+namespace hyengine
+{
+    ///Allocates coroutine frames from size-classed free lists, so coroutines started every frame don't touch the heap once warmed up.
+    [[nodiscard]] void* allocate_coroutine_frame(size_t size);
+    void free_coroutine_frame(void* frame, size_t size);
+
+    ///Schedules a suspended coroutine to be resumed on the threadpool once all dependencies have completed.
+    void resume_on_threadpool(std::coroutine_handle<> handle, std::span<threadpool_task* const> dependencies, task_priority priority);
+
+    ///Queues a suspended coroutine to be resumed on the main thread the next time process_main_thread_tasks() runs.
+    void resume_on_main_thread(std::coroutine_handle<> handle);
+
+    ///Suspends the awaiting coroutine until a set of threadpool tasks complete, then resumes it on a worker thread.
+    class task_batch_awaiter
+    {
+    public:
+        task_batch_awaiter(const std::span<threadpool_task* const> tasks, const task_priority priority) : tasks(tasks), priority(priority) {}
+
+        [[nodiscard]] bool await_ready() const
+        {
+            for (const threadpool_task* task : tasks)
+            {
+                if (!task->completed()) return false;
+            }
+            return true;
+        }
+
+        void await_suspend(const std::coroutine_handle<> handle) const
+        {
+            resume_on_threadpool(handle, tasks, priority);
+        }
+
+        void await_resume() const {}
+
+    private:
+        std::span<threadpool_task* const> tasks;
+        task_priority priority;
+    };
+
+    ///Suspends the awaiting coroutine until a threadpool task completes, then resumes it on a worker thread.
+    class task_awaiter
+    {
+    public:
+        explicit task_awaiter(threadpool_task& task) : task(&task) {}
+
+        [[nodiscard]] bool await_ready() const
+        {
+            return task->completed();
+        }
+
+        void await_suspend(const std::coroutine_handle<> handle) const
+        {
+            resume_on_threadpool(handle, std::span(&task, 1), task->get_priority());
+        }
+
+        void await_resume() const {}
+
+    private:
+        threadpool_task* task;
+    };
+
+    ///Suspends the awaiting coroutine and resumes it on the main thread.
+    class main_thread_awaiter
+    {
+    public:
+        [[nodiscard]] bool await_ready() const
+        {
+            return is_main_thread();
+        }
+
+        void await_suspend(const std::coroutine_handle<> handle) const
+        {
+            resume_on_main_thread(handle);
+        }
+
+        void await_resume() const {}
+    };
+
+    ///Suspends the awaiting coroutine and resumes it through the threadpool queues, e.g. to move back off the main thread after GL work.
+    ///Note a thread that is helping while it awaits (including the main thread) may pick the coroutine up.
+    class threadpool_awaiter
+    {
+    public:
+        explicit threadpool_awaiter(const task_priority priority) : priority(priority) {}
+
+        [[nodiscard]] bool await_ready() const
+        {
+            return false;
+        }
+
+        void await_suspend(const std::coroutine_handle<> handle) const
+        {
+            resume_on_threadpool(handle, {}, priority);
+        }
+
+        void await_resume() const {}
+
+    private:
+        task_priority priority;
+    };
+
+    ///co_await a threadpool task from a coroutine. The task must be enqueued (or completed) by someone, or the coroutine never resumes.
+    [[nodiscard]] inline task_awaiter operator co_await(threadpool_task& task)
+    {
+        return task_awaiter(task);
+    }
+
+    ///co_await a batch of threadpool tasks from a coroutine. The span must stay valid for the whole co_await expression.
+    [[nodiscard]] inline task_batch_awaiter await_all(const std::span<threadpool_task* const> tasks, const task_priority priority = task_priority::NORMAL)
+    {
+        return {tasks, priority};
+    }
+
+    [[nodiscard]] inline main_thread_awaiter switch_to_main_thread()
+    {
+        return {};
+    }
+
+    [[nodiscard]] inline threadpool_awaiter switch_to_threadpool(const task_priority priority = task_priority::NORMAL)
+    {
+        return threadpool_awaiter(priority);
+    }
+
+    template <typename value_type>
+    class coroutine_task;
+
+    ///State shared by every coroutine_task promise - completion flag, the coroutine awaiting this one, and pooled frame allocation.
+    class coroutine_promise_base
+    {
+    public:
+        [[nodiscard]] static void* operator new(const size_t size)
+        {
+            return allocate_coroutine_frame(size);
+        }
+
+        static void operator delete(void* frame, const size_t size)
+        {
+            free_coroutine_frame(frame, size);
+        }
+
+        [[nodiscard]] std::suspend_always initial_suspend() const noexcept
+        {
+            return {};
+        }
+
+        ///At the end of the coroutine, hand straight over to whoever was awaiting it, or flag completion for a root coroutine.
+        class final_awaiter
+        {
+        public:
+            [[nodiscard]] bool await_ready() const noexcept
+            {
+                return false;
+            }
+
+            template <typename promise_type>
+            std::coroutine_handle<> await_suspend(const std::coroutine_handle<promise_type> handle) const noexcept
+            {
+                coroutine_promise_base& promise = handle.promise();
+                //The owner may destroy the frame as soon as it sees done, so the store must be the last access to the promise
+                const std::coroutine_handle<> continuation = promise.continuation;
+                promise.done = true;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() const noexcept {}
+        };
+
+        [[nodiscard]] final_awaiter final_suspend() const noexcept
+        {
+            return {};
+        }
+
+        void unhandled_exception() const noexcept
+        {
+            std::terminate();
+        }
+
+        std::coroutine_handle<> continuation = nullptr;
+        atomic_bool done = false;
+    };
+
+    template <typename value_type>
+    class coroutine_promise : public coroutine_promise_base
+    {
+    public:
+        coroutine_task<value_type> get_return_object();
+
+        void return_value(value_type value)
+        {
+            result = std::move(value);
+        }
+
+        std::optional<value_type> result;
+    };
+
+    template <>
+    class coroutine_promise<void> : public coroutine_promise_base
+    {
+    public:
+        coroutine_task<void> get_return_object();
+
+        void return_void() const {}
+    };
+
+    ///Lazily started coroutine layered on the threadpool. Inside the coroutine, co_await threadpool tasks, batches of tasks (await_all),
+    ///other coroutine_tasks, switch_to_main_thread() or switch_to_threadpool().
+    ///From normal code, start() it on the threadpool and await_completed() it, or co_await it from another coroutine to run it inline.
+    template <typename value_type = void>
+    class coroutine_task
+    {
+    public:
+        using promise_type = coroutine_promise<value_type>;
+
+        explicit coroutine_task(const std::coroutine_handle<promise_type> handle) : handle(handle) {}
+
+        coroutine_task(coroutine_task&& other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+
+        coroutine_task& operator=(coroutine_task&& other) noexcept
+        {
+            if (this != &other)
+            {
+                if (handle) handle.destroy();
+                handle = std::exchange(other.handle, nullptr);
+            }
+            return *this;
+        }
+
+        coroutine_task(const coroutine_task&) = delete;
+        coroutine_task& operator=(const coroutine_task&) = delete;
+
+        ///The coroutine must have completed (or never been started) when the task is destroyed.
+        ~coroutine_task()
+        {
+            if (handle) handle.destroy();
+        }
+
+        ///Schedules the coroutine to start on the threadpool.
+        void start(const task_priority priority = task_priority::NORMAL) const
+        {
+            resume_on_threadpool(handle, {}, priority);
+        }
+
+        [[nodiscard]] bool completed() const
+        {
+            return handle.promise().done;
+        }
+
+        ///Blocks until the coroutine completes, executing queued tasks (and main thread tasks, if on the main thread) while waiting.
+        void await_completed() const
+        {
+            ZoneScoped;
+            while (!completed())
+            {
+                if (!help_execute_next_task()) std::this_thread::yield();
+            }
+        }
+
+        ///Result of a completed coroutine.
+        [[nodiscard]] auto& get_result() requires (!std::is_void_v<value_type>)
+        {
+            return *handle.promise().result;
+        }
+
+        [[nodiscard]] bool await_ready() const
+        {
+            return false;
+        }
+
+        ///Awaited from another coroutine - runs this coroutine inline, and resumes the awaiting coroutine when it finishes.
+        std::coroutine_handle<> await_suspend(const std::coroutine_handle<> awaiting) const
+        {
+            handle.promise().continuation = awaiting;
+            return handle;
+        }
+
+        value_type await_resume() const
+        {
+            if constexpr (!std::is_void_v<value_type>) return std::move(*handle.promise().result);
+        }
+
+    private:
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    template <typename value_type>
+    coroutine_task<value_type> coroutine_promise<value_type>::get_return_object()
+    {
+        return coroutine_task<value_type>(std::coroutine_handle<coroutine_promise>::from_promise(*this));
+    }
+
+    inline coroutine_task<void> coroutine_promise<void>::get_return_object()
+    {
+        return coroutine_task<void>(std::coroutine_handle<coroutine_promise>::from_promise(*this));
+    }
+}
@@ -0,0 +1,135 @@
+#include "task_graph.hpp"
+
+#include <unordered_map>
+#include <tracy/Tracy.hpp>
+
+#include "../core/logger.hpp"
+
+namespace hyengine
+{
+    void task_graph::add(threadpool_task* task)
+    {
+        tasks.push_back(task);
+        compiled = false;
+    }
+
+    bool task_graph::compile()
+    {
+        ZoneScoped;
+        compiled = false;
+        sink_tasks.clear();
+
+        std::unordered_map<const threadpool_task*, u32> task_indices;
+        task_indices.reserve(tasks.size());
+        for (u32 i = 0; i < tasks.size(); i++)
+        {
+            task_indices.emplace(tasks[i], i);
+        }
+
+        //Count in-graph dependencies and build each task's successor list
+        std::vector<u32> remaining_dependencies(tasks.size(), 0);
+        std::vector<std::vector<u32>> successors(tasks.size());
+        for (u32 i = 0; i < tasks.size(); i++)
+        {
+            for (const threadpool_task::dependency_link& link : tasks[i]->depends_on)
+            {
+                const auto dependency_index = task_indices.find(link.dependency);
+                if (dependency_index == task_indices.end())
+                {
+                    log_error(logger_tags::ASYNC, "Failed to compile task graph - a task depends on a task outside the graph");
+                    return false;
+                }
+
+                remaining_dependencies[i]++;
+                successors[dependency_index->second].push_back(i);
+            }
+        }
+
+        //Kahn's algorithm - repeatedly take a task whose dependencies have all been ordered
+        std::vector<u32> order;
+        order.reserve(tasks.size());
+        for (u32 i = 0; i < tasks.size(); i++)
+        {
+            if (remaining_dependencies[i] == 0) order.push_back(i);
+        }
+
+        for (u32 next = 0; next < order.size(); next++)
+        {
+            for (const u32 successor : successors[order[next]])
+            {
+                if (--remaining_dependencies[successor] == 0) order.push_back(successor);
+            }
+        }
+
+        if (order.size() != tasks.size())
+        {
+            log_error(logger_tags::ASYNC, "Failed to compile task graph - the graph has a cycle");
+            return false;
+        }
+
+        std::vector<threadpool_task*> ordered_tasks;
+        ordered_tasks.reserve(tasks.size());
+        for (const u32 index : order)
+        {
+            ordered_tasks.push_back(tasks[index]);
+            if (successors[index].empty()) sink_tasks.push_back(tasks[index]);
+        }
+
+        tasks = std::move(ordered_tasks);
+        compiled = true;
+        return true;
+    }
+
+    bool task_graph::is_compiled() const
+    {
+        return compiled;
+    }
+
+    void task_graph::launch()
+    {
+        ZoneScoped;
+        if (!compiled)
+        {
+            log_error(logger_tags::ASYNC, "Tried to launch a task graph that hasn't been compiled");
+            return;
+        }
+
+        for (threadpool_task* task : tasks)
+        {
+            task->reset();
+        }
+
+        //Enqueue in reverse order, so every task has registered with its dependencies before they can start
+        for (auto task = tasks.rbegin(); task != tasks.rend(); ++task)
+        {
+            (*task)->enqueue();
+        }
+
+        launched = true;
+    }
+
+    bool task_graph::completed() const
+    {
+        if (!launched) return true;
+        for (const threadpool_task* task : sink_tasks)
+        {
+            if (!task->completed()) return false;
+        }
+        return true;
+    }
+
+    void task_graph::await_completed()
+    {
+        ZoneScoped;
+        if (!launched) return;
+        for (threadpool_task* task : sink_tasks)
+        {
+            task->await_completed();
+        }
+    }
+
+    u32 task_graph::size() const
+    {
+        return static_cast<u32>(tasks.size());
+    }
+}
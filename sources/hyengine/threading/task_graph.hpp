@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+
+#include "threading.hpp"
+
+namespace hyengine
+{
+    ///A fixed set of threadpool tasks that is built and compiled once, then reset and relaunched as a whole, e.g. once per frame.
+    ///Edges come from the tasks' own dependencies. The graph does not own its tasks, and they must outlive it.
+    class task_graph
+    {
+    public:
+        ///Adds a task to the graph. Every dependency of the task must be added to the graph too.
+        void add(threadpool_task* task);
+
+        ///Orders the tasks so that each one comes after its dependencies, and finds the tasks nothing else depends on.
+        ///Fails (leaving the graph uncompiled) if a dependency isn't part of the graph or the graph has a cycle.
+        bool compile();
+
+        [[nodiscard]] bool is_compiled() const;
+
+        ///Resets every task and enqueues the graph. O(tasks) and doesn't allocate.
+        ///The graph must be compiled, and the previous launch must have completed.
+        void launch();
+
+        ///True once every task in the last launch has completed, or if the graph has never been launched.
+        [[nodiscard]] bool completed() const;
+
+        ///Blocks until the last launch has completed, executing queued tasks while waiting.
+        void await_completed();
+
+        [[nodiscard]] u32 size() const;
+
+    private:
+        ///Tasks in dependency order once compiled, insertion order before
+        std::vector<threadpool_task*> tasks;
+
+        ///Tasks nothing else in the graph depends on - the graph has completed once these have
+        std::vector<threadpool_task*> sink_tasks;
+
+        bool compiled = false;
+        bool launched = false;
+    };
+}
@@ -1,52 +1,279 @@
 #include "threading.hpp"
 
+#include <array>
 #include <atomic>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <deque>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <unordered_set>
-#include <list>
 #include <tracy/Tracy.hpp>
 
 #include "../core/logger.hpp"
 #include "hyengine/common/colors.hpp"
+#include "hyengine/common/data/work_stealing_deque.hpp"
+#include "timers.hpp"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include "windows.h"
+#elif defined(__linux__)
+#include <pthread.h>
+#endif
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
 
 namespace hyengine
 {
     static atomic_u32 thread_id_counter = 0;
-    static std::unordered_map<u32, u32> thread_id_map;
-    static std::mutex thread_id_lock;
+    static constexpr u64 THREAD_RANDOM_SEED = 0x853c49e6748fea9bULL;
 
     static std::vector<std::thread> threads;
 
+    //Per-worker task queues, one per priority lane. The owning worker pushes/pops LIFO for cache locality, idle workers steal FIFO.
+    typedef work_stealing_deque<threadpool_task*, 4096> worker_task_queue;
+    typedef std::array<worker_task_queue, TASK_PRIORITY_COUNT> worker_task_lanes;
+    static std::vector<std::unique_ptr<worker_task_lanes>> worker_queues;
+    static thread_local i32 current_worker_index = -1; //-1 for threads that aren't part of the pool
+    static thread_local bool is_current_main_thread = false;
+
+    static std::mutex injected_tasks_lock;
+    static std::array<std::deque<threadpool_task*>, TASK_PRIORITY_COUNT> injected_tasks; //Ready tasks enqueued from outside the pool, or that overflowed a worker queue
+
+    static atomic_u32 queued_task_count = 0; //Ready tasks sitting in any queue
+    static std::array<atomic_u32, TASK_PRIORITY_COUNT> queued_lane_counts {};
+    static atomic_u32 sleeping_thread_count = 0;
+
+    //Every Nth task a thread takes is looked for lowest priority lane first, so a steady stream of higher priority work can't starve the lower lanes
+    static constexpr u32 STARVATION_INTERVAL = 8;
+    static thread_local u32 tasks_taken = 0;
+
+    //Ready tasks with main thread affinity, waiting for process_main_thread_tasks()
+    static std::mutex main_thread_tasks_lock;
+    static std::array<std::deque<threadpool_task*>, TASK_PRIORITY_COUNT> main_thread_tasks;
+    static atomic_u32 queued_main_thread_task_count = 0;
+
+    static constexpr std::array<const char*, TASK_PRIORITY_COUNT> LANE_PLOT_NAMES = {"Frame critical tasks queued", "Normal tasks queued", "Background tasks queued"};
+
+    //Stats counters. Each worker has its own cache line to write to, threads outside the pool share one.
+    struct alignas(64) threadpool_counters
+    {
+        atomic_u64 tasks_executed = 0;
+        atomic_u64 tasks_stolen = 0;
+        atomic_u64 busy_ns = 0;
+        atomic_u64 sleep_ns = 0;
+        std::array<atomic_u64, TASK_TIME_HISTOGRAM_BUCKETS> start_latency {};
+        std::array<atomic_u64, TASK_TIME_HISTOGRAM_BUCKETS> run_time {};
+    };
+
+    static std::vector<std::unique_ptr<threadpool_counters>> worker_counters;
+    static threadpool_counters external_counters;
+    static atomic_u64 stats_start_ns = 0;
+    static thread_local u32 task_depth = 0; //Tasks executed while awaiting inside another task are nested, so their run time isn't counted as busy twice
+
     static std::mutex threadpool_work_lock;
     static std::condition_variable threadpool_work_condition;
 
     static bool should_threads_exit;
-    static std::vector<threadpool_task*> waiting_tasks; //Tasks that cannot be executed yet due to waiting on dependencies
-    static std::list<threadpool_task*> ready_tasks;     //Tasks that are not waiting on dependencies and can be dequeued
+    static threadpool_config active_config;
+    static timer_id log_flush_timer = INVALID_TIMER;
+
+    ///Hints to the CPU that we're in a spin-wait loop
+    inline void cpu_relax()
+    {
+        #if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+        _mm_pause();
+        #elif defined(__aarch64__) || defined(_M_ARM64)
+        __asm__ __volatile__("yield");
+        #endif
+    }
+
+    bool try_pin_thread(std::thread& thread, const u32 core)
+    {
+        #if defined(_WIN32)
+        return SetThreadAffinityMask(thread.native_handle(), static_cast<DWORD_PTR>(1) << core) != 0;
+        #elif defined(__linux__)
+        cpu_set_t cpu_set;
+        CPU_ZERO(&cpu_set);
+        CPU_SET(core, &cpu_set);
+        return pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpu_set) == 0;
+        #else
+        return false;
+        #endif
+    }
+
+    u64 now_ns()
+    {
+        return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    threadpool_counters& current_counters()
+    {
+        return current_worker_index >= 0 ? *worker_counters[current_worker_index] : external_counters;
+    }
+
+    void count_task_time(std::array<atomic_u64, TASK_TIME_HISTOGRAM_BUCKETS>& histogram, const u64 duration_ns)
+    {
+        const u32 bucket = std::min(static_cast<u32>(std::bit_width(duration_ns)), TASK_TIME_HISTOGRAM_BUCKETS - 1);
+        histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void wake_sleeping_thread()
+    {
+        if (sleeping_thread_count.load() == 0) return;
+
+        //Taking the lock guarantees a thread that saw no queued tasks is already waiting on the condition, so it can't miss the notify
+        threadpool_work_lock.lock();
+        threadpool_work_lock.unlock();
+        threadpool_work_condition.notify_one();
+    }
+
+    void schedule_main_thread_task(threadpool_task* task, const task_priority priority)
+    {
+        main_thread_tasks_lock.lock();
+        main_thread_tasks[static_cast<u8>(priority)].push_back(task);
+        main_thread_tasks_lock.unlock();
+
+        [[maybe_unused]] const u32 count = queued_main_thread_task_count.fetch_add(1) + 1;
+        TracyPlot("Main thread tasks queued", static_cast<i64>(count));
+    }
+
+    ///Pushes a ready task onto the current worker's queue for its lane, or the shared injection queue if called from outside the pool
+    void schedule_ready_task(threadpool_task* task, const task_priority priority, const bool main_thread_only)
+    {
+        if (main_thread_only)
+        {
+            schedule_main_thread_task(task, priority);
+            return;
+        }
+
+        const u8 lane = static_cast<u8>(priority);
+        [[maybe_unused]] const u32 lane_count = queued_lane_counts[lane].fetch_add(1) + 1;
+        queued_task_count.fetch_add(1);
+        TracyPlot(LANE_PLOT_NAMES[lane], static_cast<i64>(lane_count));
+
+        const bool pushed_local = current_worker_index >= 0 && (*worker_queues[current_worker_index])[lane].push(task);
+        if (!pushed_local)
+        {
+            injected_tasks_lock.lock();
+            injected_tasks[lane].push_back(task);
+            injected_tasks_lock.unlock();
+        }
+
+        wake_sleeping_thread();
+    }
+
+    threadpool_task* take_injected_task(const u8 lane)
+    {
+        threadpool_task* task = nullptr;
+        injected_tasks_lock.lock();
+        if (!injected_tasks[lane].empty())
+        {
+            task = injected_tasks[lane].front();
+            injected_tasks[lane].pop_front();
+        }
+        injected_tasks_lock.unlock();
+        return task;
+    }
+
+    threadpool_task* steal_task(const u8 lane)
+    {
+        const i32 queue_count = static_cast<i32>(worker_queues.size());
+        const i32 start_index = current_worker_index + 1;
+        for (i32 i = 0; i < queue_count; i++)
+        {
+            const i32 victim_index = (start_index + i) % queue_count;
+            if (victim_index == current_worker_index) continue;
+
+            threadpool_task* task = nullptr;
+            if ((*worker_queues[victim_index])[lane].steal(task))
+            {
+                current_counters().tasks_stolen.fetch_add(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    threadpool_task* take_lane_task(const u8 lane)
+    {
+        if (queued_lane_counts[lane].load(std::memory_order_relaxed) == 0) return nullptr;
+
+        threadpool_task* task = nullptr;
+        const bool popped_local = current_worker_index >= 0 && (*worker_queues[current_worker_index])[lane].pop(task);
+        if (!popped_local) task = take_injected_task(lane);
+        if (task == nullptr) task = steal_task(lane);
+        if (task == nullptr) return nullptr;
+
+        [[maybe_unused]] const u32 lane_count = queued_lane_counts[lane].fetch_sub(1) - 1;
+        queued_task_count.fetch_sub(1);
+        TracyPlot(LANE_PLOT_NAMES[lane], static_cast<i64>(lane_count));
+        return task;
+    }
+
+    threadpool_task* take_next_task()
+    {
+        if (queued_task_count.load(std::memory_order_relaxed) == 0) return nullptr;
+
+        tasks_taken++;
+        const bool lowest_first = tasks_taken % STARVATION_INTERVAL == 0;
+        for (u8 i = 0; i < TASK_PRIORITY_COUNT; i++)
+        {
+            const u8 lane = lowest_first ? TASK_PRIORITY_COUNT - 1 - i : i;
+            threadpool_task* task = take_lane_task(lane);
+            if (task != nullptr) return task;
+        }
+
+        return nullptr;
+    }
 
     void thread_loop()
     {
         ZoneScopedC(0x00FF77);
         log_debug(logger_tags::ASYNC, "Thread entering threadpool loop");
+        const u32 spin_count = active_config.idle_spin_count;
+        const u32 spin_and_yield_count = spin_count + active_config.idle_yield_count;
+        u32 idle_polls = 0;
         while (true)
         {
             const bool did_execute_task = execute_next_task();
-            if (did_execute_task) continue; //work until no more tasks available
+            if (did_execute_task) //work until no more tasks available
+            {
+                idle_polls = 0;
+                continue;
+            }
 
-            //Exit / work conditions could be changed here; thread would block until changes written
+            //Keep polling for a little while before paying for a sleep and wake-up
+            if (idle_polls < spin_and_yield_count)
+            {
+                if (idle_polls < spin_count) cpu_relax();
+                else std::this_thread::yield();
+                idle_polls++;
+                continue;
+            }
+            idle_polls = 0;
 
             std::unique_lock lock(threadpool_work_lock); //block until we get the lock
 
-            //Exit/work conditions can't be changed here - would block and wait for this thread to check them
+            //Exit conditions can't be changed here - would block and wait for this thread to check them
 
             if (should_threads_exit) break; //check if we should exit
-            if (ready_tasks.empty())        //check if a task has been added since we finished the last one to prevent deadlock
+
+            sleeping_thread_count.fetch_add(1);
+            if (queued_task_count.load() == 0) //check if a task has been added since we finished the last one to prevent deadlock
             {
+                const u64 sleep_start = now_ns();
                 threadpool_work_condition.wait(lock); //Lock released here, exit/work conditions can be changed and thread will see notifications
+                current_counters().sleep_ns.fetch_add(now_ns() - sleep_start, std::memory_order_relaxed);
             }
+            sleeping_thread_count.fetch_sub(1);
 
             //Lock is re-locked here by waking thread
 
@@ -55,7 +282,7 @@ namespace hyengine
         log_debug(logger_tags::ASYNC, "Thread exiting threadpool loop");
     }
 
-    void create_threadpool()
+    void create_threadpool(const threadpool_config& config)
     {
         ZoneScoped;
         threadpool_work_lock.lock();
@@ -69,27 +296,47 @@ namespace hyengine
 
         log_info(logger_tags::ASYNC, "Creating threadpool");
 
+        is_current_main_thread = true;
+
         should_threads_exit = false;
+        active_config = config;
 
-        //We want one task thread per logical core, leaving two cores free for the main thread and OS
+        //By default we want one task thread per logical core, leaving two cores free for the main thread and OS
         //If there isn't any logical cores available (or the hardware concurrency hint is unavailable) we just make 3.
-        const i32 available_logical_cores = std::thread::hardware_concurrency() - 2;
-        const u32 thread_count = static_cast<u32>(std::max(available_logical_cores, 3));
+        const u32 logical_cores = std::thread::hardware_concurrency();
+        const i32 available_logical_cores = static_cast<i32>(logical_cores) - 2;
+        const u32 thread_count = config.worker_count > 0 ? config.worker_count : static_cast<u32>(std::max(available_logical_cores, 3));
+        worker_queues.clear();
+        worker_counters.clear();
+        for (u32 i = 0; i < thread_count; ++i)
+        {
+            worker_queues.push_back(std::make_unique<worker_task_lanes>());
+            worker_counters.push_back(std::make_unique<threadpool_counters>());
+        }
+        reset_threadpool_stats();
+
         threads.reserve(thread_count);
         for (u32 i = 0; i < thread_count; ++i)
         {
             threads.emplace_back([i]
             {
-                // Tracy requires memory passed to the profiler to be pinned and never unallocated.
-                // ReSharper disable once CppDFAMemoryLeak
-                char* thread_name = new char[16];
-                snprintf(thread_name, 16, " Worker %i ", i);
-                tracy::SetThreadName(thread_name);
+                current_worker_index = static_cast<i32>(i);
+                set_current_thread_name(stringify(" Worker ", i, " "));
                 thread_loop();
             });
+
+            if (config.pin_workers_to_cores && logical_cores > 0)
+            {
+                const u32 core = (config.first_pinned_core + i) % logical_cores;
+                if (!try_pin_thread(threads.back(), core)) log_warn(logger_tags::ASYNC, "Failed to pin worker ", i, " to core ", core);
+            }
         }
 
         threadpool_work_lock.unlock();
+
+        start_timers(config.timer_tick_time);
+        if (config.log_flush_interval > 0) log_flush_timer = schedule_repeating(flush_logs, config.log_flush_interval, task_priority::BACKGROUND);
+
         log_info(logger_tags::ASYNC, "Threadpool created with ", threads.size(), " threads. (based on ", available_logical_cores, " logical cores)");
     }
 
@@ -97,6 +344,10 @@ namespace hyengine
     {
         ZoneScoped;
 
+        cancel_timer(log_flush_timer);
+        log_flush_timer = INVALID_TIMER;
+        stop_timers();
+
         threadpool_work_lock.lock();
         should_threads_exit = true;
         threadpool_work_lock.unlock();
@@ -110,32 +361,23 @@ namespace hyengine
 
         log_info(logger_tags::ASYNC, "Released threadpool.");
         threads.clear();
-    }
 
-    void update_waiting_tasks()
-    {
-        ZoneScoped;
-        threadpool_work_lock.lock();
-        erase_if(waiting_tasks, [](threadpool_task* task)
+        //Anything left in the worker queues is handed to the injection queue so it can still be executed/awaited from the main thread
+        for (const std::unique_ptr<worker_task_lanes>& lanes : worker_queues)
         {
-            const bool is_ready = task->dependencies_completed();
-            if (is_ready) ready_tasks.push_back(task);
-            return is_ready;
-        });
-        threadpool_work_lock.unlock();
+            for (u8 lane = 0; lane < TASK_PRIORITY_COUNT; lane++)
+            {
+                threadpool_task* task = nullptr;
+                while ((*lanes)[lane].pop(task)) injected_tasks[lane].push_back(task);
+            }
+        }
+        worker_queues.clear();
     }
 
     //True if a task was executed
     bool execute_next_task()
     {
-        threadpool_task* next_task = nullptr;
-        threadpool_work_lock.lock();
-        if (!ready_tasks.empty())
-        {
-            next_task = ready_tasks.front();
-            ready_tasks.pop_front();
-        }
-        threadpool_work_lock.unlock();
+        threadpool_task* next_task = take_next_task();
 
         if (next_task == nullptr)
         {
@@ -143,58 +385,349 @@ namespace hyengine
         }
 
         next_task->try_execute_task();
-        update_waiting_tasks();
 
         return true;
     }
 
     bool has_next_task()
     {
-        bool result = true;
-        threadpool_work_lock.lock();
-        if (ready_tasks.empty()) result = false;
-        threadpool_work_lock.unlock();
-        return result;
+        return queued_task_count.load() > 0;
     }
 
-    u32 get_current_thread_id()
+    u32 get_threadpool_size()
+    {
+        return static_cast<u32>(worker_queues.size());
+    }
+
+    f64 histogram_percentile(const task_time_histogram& histogram, const f64 fraction)
+    {
+        u64 total = 0;
+        for (const u64 count : histogram) total += count;
+        if (total == 0) return 0;
+
+        const u64 target = static_cast<u64>(std::ceil(static_cast<f64>(total) * fraction));
+        u64 counted = 0;
+        for (u32 bucket = 0; bucket < TASK_TIME_HISTOGRAM_BUCKETS; bucket++)
+        {
+            counted += histogram[bucket];
+            if (counted >= target) return static_cast<f64>(1ULL << bucket) / 1e9;
+        }
+        return static_cast<f64>(1ULL << (TASK_TIME_HISTOGRAM_BUCKETS - 1)) / 1e9;
+    }
+
+    f64 threadpool_stats::get_worker_utilization() const
     {
-        thread_id_lock.lock();
-        u32 id = 0;
-        const u32 hash = std::hash<std::thread::id> {}(std::this_thread::get_id());
-        if (thread_id_map.contains(hash))
+        const f64 available_time = elapsed_time * worker_count;
+        return available_time > 0 ? worker_busy_time / available_time : 0;
+    }
+
+    void add_counters(threadpool_stats& stats, const threadpool_counters& counters)
+    {
+        for (u32 bucket = 0; bucket < TASK_TIME_HISTOGRAM_BUCKETS; bucket++)
         {
-            id = thread_id_map[hash];
+            stats.start_latency[bucket] += counters.start_latency[bucket].load(std::memory_order_relaxed);
+            stats.run_time[bucket] += counters.run_time[bucket].load(std::memory_order_relaxed);
         }
-        else
+        stats.tasks_executed += counters.tasks_executed.load(std::memory_order_relaxed);
+        stats.tasks_stolen += counters.tasks_stolen.load(std::memory_order_relaxed);
+    }
+
+    threadpool_stats get_threadpool_stats()
+    {
+        threadpool_stats stats;
+        stats.worker_count = static_cast<u32>(worker_counters.size());
+        stats.elapsed_time = static_cast<f64>(now_ns() - stats_start_ns.load()) / 1e9;
+
+        for (const std::unique_ptr<threadpool_counters>& counters : worker_counters)
         {
-            id = thread_id_counter;
-            thread_id_counter += 1;
-            thread_id_map[hash] = id;
+            add_counters(stats, *counters);
+            stats.worker_busy_time += static_cast<f64>(counters->busy_ns.load(std::memory_order_relaxed)) / 1e9;
+            stats.worker_sleep_time += static_cast<f64>(counters->sleep_ns.load(std::memory_order_relaxed)) / 1e9;
         }
-        thread_id_lock.unlock();
 
-        return id;
+        const u64 tasks_executed_by_workers = stats.tasks_executed;
+        add_counters(stats, external_counters);
+        stats.tasks_executed_outside_pool = stats.tasks_executed - tasks_executed_by_workers;
+
+        return stats;
     }
 
-    void threadpool_task::enqueue()
+    void reset_counters(threadpool_counters& counters)
     {
-        if (!state_ready()) return; //Task already running or completed
+        counters.tasks_executed = 0;
+        counters.tasks_stolen = 0;
+        counters.busy_ns = 0;
+        counters.sleep_ns = 0;
+        for (atomic_u64& count : counters.start_latency) count = 0;
+        for (atomic_u64& count : counters.run_time) count = 0;
+    }
 
-        threadpool_work_lock.lock();
-        const bool ready = dependencies_completed();
+    void reset_threadpool_stats()
+    {
+        for (const std::unique_ptr<threadpool_counters>& counters : worker_counters) reset_counters(*counters);
+        reset_counters(external_counters);
+        stats_start_ns = now_ns();
+    }
 
-        if (ready)
+    void plot_threadpool_stats()
+    {
+        //Plot the change since the last call, so spikes aren't averaged away
+        static threadpool_stats last_stats;
+        const threadpool_stats stats = get_threadpool_stats();
+        if (stats.elapsed_time < last_stats.elapsed_time) last_stats = {}; //Stats were reset
+
+        threadpool_stats interval = stats;
+        interval.tasks_executed -= last_stats.tasks_executed;
+        interval.tasks_stolen -= last_stats.tasks_stolen;
+        interval.elapsed_time -= last_stats.elapsed_time;
+        interval.worker_busy_time -= last_stats.worker_busy_time;
+        for (u32 bucket = 0; bucket < TASK_TIME_HISTOGRAM_BUCKETS; bucket++)
         {
-            ready_tasks.push_back(this);
+            interval.start_latency[bucket] -= last_stats.start_latency[bucket];
+            interval.run_time[bucket] -= last_stats.run_time[bucket];
         }
-        else
+        last_stats = stats;
+
+        TracyPlot("Tasks executed", static_cast<i64>(interval.tasks_executed));
+        TracyPlot("Tasks stolen", static_cast<i64>(interval.tasks_stolen));
+        TracyPlot("Worker utilization %", interval.get_worker_utilization() * 100.0);
+        TracyPlot("Task start latency p99 (us)", histogram_percentile(interval.start_latency, 0.99) * 1e6);
+        TracyPlot("Task run time p99 (us)", histogram_percentile(interval.run_time, 0.99) * 1e6);
+    }
+
+    bool is_main_thread()
+    {
+        return is_current_main_thread;
+    }
+
+    bool help_execute_next_task()
+    {
+        return (is_main_thread() && execute_next_main_thread_task()) || execute_next_task();
+    }
+
+    bool execute_next_main_thread_task()
+    {
+        if (queued_main_thread_task_count.load(std::memory_order_relaxed) == 0) return false;
+
+        threadpool_task* next_task = nullptr;
+        main_thread_tasks_lock.lock();
+        for (std::deque<threadpool_task*>& lane : main_thread_tasks)
         {
-            waiting_tasks.push_back(this);
+            if (lane.empty()) continue;
+            next_task = lane.front();
+            lane.pop_front();
+            break;
         }
+        main_thread_tasks_lock.unlock();
 
-        threadpool_work_lock.unlock();
-        threadpool_work_condition.notify_one();
+        if (next_task == nullptr) return false;
+
+        [[maybe_unused]] const u32 count = queued_main_thread_task_count.fetch_sub(1) - 1;
+        TracyPlot("Main thread tasks queued", static_cast<i64>(count));
+
+        next_task->try_execute_task();
+        return true;
+    }
+
+    void process_main_thread_tasks(const f64 time_budget)
+    {
+        ZoneScoped;
+        const auto start_time = std::chrono::steady_clock::now();
+        const auto budget = std::chrono::duration<f64>(time_budget);
+        while (execute_next_main_thread_task())
+        {
+            if (std::chrono::steady_clock::now() - start_time >= budget) break;
+        }
+    }
+
+    task_group::~task_group()
+    {
+        wait();
+    }
+
+    void task_group::run(threadpool_task* task)
+    {
+        task->set_cancellation_token(&cancellation);
+        tasks.push_back(task);
+        task->enqueue();
+    }
+
+    void task_group::run(std::function<void()> function, const task_priority priority)
+    {
+        owned_tasks.push_back(std::make_unique<function_task>(std::move(function)));
+        function_task* task = owned_tasks.back().get();
+        task->set_priority(priority);
+        run(task);
+    }
+
+    void task_group::cancel()
+    {
+        cancellation.cancel();
+    }
+
+    const cancellation_token* task_group::get_cancellation_token() const
+    {
+        return &cancellation;
+    }
+
+    void task_group::wait()
+    {
+        ZoneScoped;
+        for (threadpool_task* task : tasks)
+        {
+            task->await_completed();
+        }
+
+        //Continuations of the group's tasks aren't in the group, but still read its token until they're released
+        while (cancellation.has_pending_continuations())
+        {
+            if (!help_execute_next_task()) std::this_thread::yield();
+        }
+
+        tasks.clear();
+        owned_tasks.clear();
+        cancellation.reset();
+    }
+
+    void enqueue_main_thread(std::function<void()> function, const task_priority priority)
+    {
+        function_task* task = new function_task(std::move(function));
+        task->set_priority(priority);
+        task->set_main_thread_affinity(true);
+        task->enqueue_detached();
+    }
+
+    thread_context& get_thread_context()
+    {
+        static thread_local thread_context context = [] {
+            const u32 id = thread_id_counter.fetch_add(1);
+            return thread_context {id, "", scratch_arena(), pcg::pcg32(THREAD_RANDOM_SEED, id)};
+        }();
+        return context;
+    }
+
+    void set_current_thread_name(const std::string_view& name)
+    {
+        // Tracy requires memory passed to the profiler to be pinned and never unallocated.
+        // ReSharper disable once CppDFAMemoryLeak
+        char* thread_name = new char[name.size() + 1];
+        memcpy(thread_name, name.data(), name.size());
+        thread_name[name.size()] = '\0';
+
+        get_thread_context().name = thread_name;
+        tracy::SetThreadName(thread_name);
+    }
+
+    u32 get_current_thread_id()
+    {
+        return get_thread_context().thread_id;
+    }
+
+    void cancellation_token::cancel()
+    {
+        cancelled = true;
+    }
+
+    bool cancellation_token::is_cancelled() const
+    {
+        return cancelled.load(std::memory_order_relaxed);
+    }
+
+    void cancellation_token::reset()
+    {
+        cancelled = false;
+    }
+
+    bool cancellation_token::has_pending_continuations() const
+    {
+        return pending_continuations.load() > 0;
+    }
+
+    ///Detached task queued by threadpool_task::then. Holds its cancellation token as pending until it has been released.
+    class continuation_task final : public threadpool_task
+    {
+    public:
+        continuation_task(std::function<void()> function, threadpool_task* parent) : threadpool_task({parent}), function(std::move(function)) {}
+
+    protected:
+        void execute() override
+        {
+            function();
+        }
+
+        void release_detached() override
+        {
+            //The token's owner may destroy it as soon as the count drops, so let go of it last
+            const cancellation_token* token = get_cancellation_token();
+            delete this;
+            if (token != nullptr) token->pending_continuations.fetch_sub(1);
+        }
+
+    private:
+        std::function<void()> function;
+    };
+
+    threadpool_task::dependency_link threadpool_task::successors_closed = {nullptr, nullptr, nullptr};
+
+    void threadpool_task::enqueue()
+    {
+        if (!state_ready()) return; //Task already running or completed
+        if (is_enqueued.exchange(true)) return; //Task already enqueued
+
+        //Register with every dependency that hasn't finished yet - they will count us down when they complete
+        for (dependency_link& link : depends_on)
+        {
+            if (!link.dependency->try_add_successor(&link)) dependency_completed();
+        }
+
+        //Release the extra count held until enqueue, the task is scheduled by whichever thread brings the count to zero
+        dependency_completed();
+    }
+
+    void threadpool_task::enqueue_detached()
+    {
+        is_detached = true;
+        enqueue();
+    }
+
+    void threadpool_task::set_priority(const task_priority new_priority)
+    {
+        priority = new_priority;
+    }
+
+    task_priority threadpool_task::get_priority() const
+    {
+        return priority;
+    }
+
+    void threadpool_task::set_main_thread_affinity(const bool main_thread_only)
+    {
+        this->main_thread_only = main_thread_only;
+    }
+
+    bool threadpool_task::has_main_thread_affinity() const
+    {
+        return main_thread_only;
+    }
+
+    void threadpool_task::set_cancellation_token(const cancellation_token* token)
+    {
+        cancellation = token;
+    }
+
+    const cancellation_token* threadpool_task::get_cancellation_token() const
+    {
+        return cancellation;
+    }
+
+    void threadpool_task::then(std::function<void()> continuation)
+    {
+        continuation_task* task = new continuation_task(std::move(continuation), this);
+        task->set_priority(priority);
+        task->set_main_thread_affinity(main_thread_only);
+        task->set_cancellation_token(cancellation);
+        if (cancellation != nullptr) cancellation->pending_continuations.fetch_add(1);
+        task->enqueue_detached();
     }
 
     bool threadpool_task::completed() const
@@ -202,31 +735,97 @@ namespace hyengine
         return state == execution_state::COMPLETED;
     }
 
+    bool threadpool_task::was_cancelled() const
+    {
+        return dropped;
+    }
+
     void threadpool_task::await_completed()
     {
         ZoneScoped;
-        const bool executed_immediately = try_execute_task();
+        const bool executed_immediately = try_execute_inline();
         if (executed_immediately) return;
-        completion_future.wait();
+
+        //Help out with other work until the task completes - it may be sitting in this thread's own queue, or waiting on tasks that are
+        execution_state current_state = state.load();
+        while (current_state != execution_state::COMPLETED)
+        {
+            if (help_execute_next_task())
+            {
+                current_state = state.load();
+                continue;
+            }
+
+            //Nothing to help with. A running task will complete without us, so sleep until it does, and a finishing one is moments away.
+            //A waiting task still needs its dependencies to run, so keep checking for new work.
+            if (current_state == execution_state::RUNNING) state.wait(current_state);
+            else if (current_state == execution_state::FINISHING) cpu_relax();
+            else std::this_thread::yield();
+
+            current_state = state.load();
+        }
     }
 
     bool threadpool_task::await_timeout(const u32 timeout_ms) const
     {
         ZoneScoped;
-        completion_future.wait_for(std::chrono::milliseconds(timeout_ms));
-        return completed();
+        //Atomic waits can't time out, so poll the state instead
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+        while (!completed())
+        {
+            if (std::chrono::steady_clock::now() >= deadline) return false;
+            std::this_thread::yield();
+        }
+        return true;
     }
 
+    void threadpool_task::reset()
+    {
+        for (dependency_link& link : depends_on)
+        {
+            link.next = nullptr;
+        }
+
+        successors = nullptr;
+        ready_time_ns = 0;
+        dropped = false;
+        pending_dependencies = static_cast<u32>(depends_on.size()) + 1;
+        is_enqueued = false;
+        state = execution_state::WAITING;
+    }
 
     bool threadpool_task::try_execute_task()
     {
         ZoneScoped;
-        if (dependencies_completed() && state_ready())
+        //Only called once dependencies have completed - queued tasks are ready, and inline execution checks first.
+        //Dependencies aren't touched here, as they may have been destroyed once complete.
+        execution_state expected = execution_state::WAITING;
+        if (state.compare_exchange_strong(expected, execution_state::RUNNING))
         {
-            state = execution_state::RUNNING;
+            const bool release_after = is_detached;
+            if (cancellation != nullptr && cancellation->is_cancelled())
+            {
+                dropped = true;
+                complete();
+                if (release_after) release_detached();
+                return true;
+            }
+
+            threadpool_counters& counters = current_counters();
+            const u64 start_time = now_ns();
+            if (ready_time_ns != 0) count_task_time(counters.start_latency, start_time - ready_time_ns);
+
+            task_depth++;
             execute();
-            completion_promise.set_value();
-            state = execution_state::COMPLETED;
+            task_depth--;
+
+            const u64 run_time = now_ns() - start_time;
+            count_task_time(counters.run_time, run_time);
+            counters.tasks_executed.fetch_add(1, std::memory_order_relaxed);
+            if (current_worker_index >= 0 && task_depth == 0) counters.busy_ns.fetch_add(run_time, std::memory_order_relaxed);
+
+            complete();
+            if (release_after) release_detached();
             return true;
         }
 
@@ -235,13 +834,60 @@ namespace hyengine
 
     bool threadpool_task::dependencies_completed() const
     {
-        for (const threadpool_task* dependent : depends_on)
+        for (const dependency_link& link : depends_on)
+        {
+            if (!link.dependency->completed()) return false;
+        }
+        return true;
+    }
+
+    bool threadpool_task::try_execute_inline()
+    {
+        if (!dependencies_completed()) return false;
+        if (is_enqueued.exchange(true)) return false; //Claiming the enqueued flag stops a later enqueue from queueing a completed task
+        return try_execute_task();
+    }
+
+    void threadpool_task::complete()
+    {
+        //Close the successor list, so a concurrent enqueue either registered before this or sees the task as completed
+        dependency_link* link = successors.exchange(&successors_closed);
+
+        //Owners are free to destroy the task as soon as it reports completion, so wake sleeping waiters first - they spin through FINISHING
+        //until the final store, which must be the last access to the task
+        state = execution_state::FINISHING;
+        state.notify_all();
+        state = execution_state::COMPLETED;
+
+        while (link != nullptr)
+        {
+            dependency_link* next = link->next; //Read before counting down - the successor may run and be destroyed straight away
+            link->successor->dependency_completed();
+            link = next;
+        }
+    }
+
+    bool threadpool_task::try_add_successor(dependency_link* link)
+    {
+        dependency_link* head = successors.load();
+        do
         {
-            if (!dependent->completed()) return false;
+            if (head == &successors_closed) return false;
+            link->next = head;
         }
+        while (!successors.compare_exchange_weak(head, link));
+
         return true;
     }
 
+    void threadpool_task::dependency_completed()
+    {
+        if (pending_dependencies.fetch_sub(1) != 1) return;
+
+        ready_time_ns = now_ns();
+        schedule_ready_task(this, priority, main_thread_only);
+    }
+
     bool threadpool_task::state_ready() const
     {
         return state == execution_state::WAITING;
@@ -1,63 +1,522 @@
 #pragma once
+#include <array>
 #include <atomic>
-#include <future>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <span>
+#include <vector>
 
+#include "hyengine/common/scratch_arena.hpp"
 #include "hyengine/common/sized_numerics.hpp"
+#include "pcg/pcg_random.hpp"
 
 namespace hyengine
 {
-    void create_threadpool();
+    ///Scheduling lanes for tasks. Workers take from higher priority lanes first, but periodically serve the lower lanes so they can't be starved.
+    enum class task_priority : u8
+    {
+        FRAME_CRITICAL = 0, //Work the current frame is waiting on
+        NORMAL = 1,
+        BACKGROUND = 2      //IO, asset loading, log flushing and other work that can slip a frame
+    };
+
+    constexpr u8 TASK_PRIORITY_COUNT = 3;
+
+    struct threadpool_config
+    {
+        ///Number of worker threads. Zero picks one per logical core, leaving two free for the main thread and OS (and never less than 3).
+        u32 worker_count = 0;
+
+        ///Pins each worker to its own logical core, starting from first_pinned_core and wrapping around the available cores.
+        bool pin_workers_to_cores = false;
+        u32 first_pinned_core = 1;
+
+        ///How many times an idle worker polls for work with a CPU pause hint, then with a thread yield, before sleeping.
+        ///Spinning trades CPU time for lower wake-up latency on enqueue bursts. Set both to zero to sleep straight away.
+        u32 idle_spin_count = 256;
+        u32 idle_yield_count = 16;
+
+        ///Resolution of delayed and repeating timers, in seconds. Timers fire up to one tick late.
+        f64 timer_tick_time = 0.001;
+
+        ///How often buffered log messages are flushed in the background, in seconds. Zero leaves flushing to explicit flush_logs() calls.
+        f64 log_flush_interval = 0.1;
+    };
+
+    void create_threadpool(const threadpool_config& config = {});
+
+    constexpr u32 TASK_TIME_HISTOGRAM_BUCKETS = 40;
+
+    ///Task durations counted in power of two buckets - bucket N counts durations under 2^N nanoseconds that didn't fit bucket N - 1.
+    typedef std::array<u64, TASK_TIME_HISTOGRAM_BUCKETS> task_time_histogram;
+
+    ///Approximate duration, in seconds, that the given fraction of samples fall under, e.g. 0.99 for the 99th percentile. Rounds up to a bucket edge.
+    f64 histogram_percentile(const task_time_histogram& histogram, f64 fraction);
+
+    ///Threadpool counters accumulated since the pool was created or the stats were last reset.
+    ///Tasks run by threads outside the pool (awaiting threads helping out, the main thread) are counted, but not as worker time.
+    struct threadpool_stats
+    {
+        u32 worker_count = 0;
+        u64 tasks_executed = 0;
+        u64 tasks_executed_outside_pool = 0;
+        u64 tasks_stolen = 0;
+
+        ///Seconds since the stats started accumulating.
+        f64 elapsed_time = 0;
+        ///Seconds workers spent executing tasks, summed across workers.
+        f64 worker_busy_time = 0;
+        ///Seconds workers spent asleep waiting for work, summed across workers.
+        f64 worker_sleep_time = 0;
+
+        ///Time from a task becoming ready (enqueued with all dependencies completed) to it starting. Tasks run inline aren't counted.
+        task_time_histogram start_latency {};
+        ///Time spent executing each task.
+        task_time_histogram run_time {};
+
+        ///Fraction of available worker time spent executing tasks.
+        [[nodiscard]] f64 get_worker_utilization() const;
+    };
+
+    ///Gathers the counters from every thread. Cheap enough to call every frame, but concurrent updates may be missed.
+    threadpool_stats get_threadpool_stats();
+    void reset_threadpool_stats();
+
+    ///Plots threadpool activity since the last call to Tracy. Called once per frame by the frame loop.
+    void plot_threadpool_stats();
     void release_threadpool();
 
     bool execute_next_task();
     bool has_next_task();
 
+    ///Number of worker threads in the pool (not counting the main thread). Zero if the threadpool hasn't been created.
+    u32 get_threadpool_size();
+
+    ///Per-thread state, created the first time a thread asks for it and never shared, so none of it needs locking.
+    struct thread_context
+    {
+        ///Stable ID, assigned sequentially in the order threads first ask for their context.
+        u32 thread_id;
+
+        ///Name shown in Tracy. Empty until set_current_thread_name() is called.
+        const char* name;
+
+        ///Scratch memory for hot paths on this thread. Callers should rewind what they use (see scratch_scope).
+        scratch_arena scratch;
+
+        ///Random stream unique to this thread (the stream is selected by thread ID).
+        pcg::pcg32 random;
+    };
+
+    [[nodiscard]] thread_context& get_thread_context();
+
+    ///Names the current thread in its context and in Tracy.
+    void set_current_thread_name(const std::string_view& name);
+
     u32 get_current_thread_id();
 
+    ///True on the thread that created the threadpool (the thread owning the GL context and running the frame loop).
+    bool is_main_thread();
+
+    ///Executes the next task queued for the main thread, if any. Must be called from the main thread.
+    bool execute_next_main_thread_task();
+
+    ///Executes one queued task while blocked waiting on something - a main thread task first when called on the main thread, as what's
+    ///being waited on may need one to finish, then any threadpool task. Returns false if there was nothing to run.
+    bool help_execute_next_task();
+
+    ///Executes tasks queued for the main thread until the queue is empty or the time budget (in seconds) is used up.
+    ///At least one task is executed if any are queued. Called by the frame loop each frame. Must be called from the main thread.
+    void process_main_thread_tasks(f64 time_budget);
+
+    ///Queues a function to run on the main thread, e.g. GL uploads for data prepared on a worker. Safe to call from any thread.
+    void enqueue_main_thread(std::function<void()> function, task_priority priority = task_priority::NORMAL);
+
+    ///Flag shared by a set of tasks to abandon them. Tasks holding a cancelled token are dropped without executing when they come up,
+    ///and running tasks may poll is_cancelled() to stop early. Dropped tasks still complete, so anything awaiting or depending on them is released.
+    class cancellation_token
+    {
+    public:
+        void cancel();
+        [[nodiscard]] bool is_cancelled() const;
+
+        ///Clears the flag so the token can be reused. Tasks already dropped stay dropped.
+        void reset();
+
+        ///True while continuations queued with this token (see threadpool_task::then) haven't been released yet.
+        [[nodiscard]] bool has_pending_continuations() const;
+
+    private:
+        friend class threadpool_task;
+        friend class continuation_task;
+
+        atomic_bool cancelled = false;
+
+        ///Continuations holding the token, so whoever owns it can wait for them before it goes away
+        mutable atomic_u32 pending_continuations = 0;
+    };
+
     class threadpool_task
     {
     public:
-        threadpool_task(const std::initializer_list<threadpool_task*> dependencies) : depends_on(dependencies)
+        explicit threadpool_task(const std::span<threadpool_task* const> dependencies) : pending_dependencies(static_cast<u32>(dependencies.size()) + 1)
         {
-            completion_promise = std::promise<void>();
-            completion_future = completion_promise.get_future();
+            //Most tasks have a dependency or two, so only larger sets go to the heap
+            dependency_link* links = inline_dependencies.data();
+            if (dependencies.size() > INLINE_DEPENDENCY_COUNT)
+            {
+                heap_dependencies = std::make_unique<dependency_link[]>(dependencies.size());
+                links = heap_dependencies.get();
+            }
+
+            for (u64 i = 0; i < dependencies.size(); i++)
+            {
+                links[i] = {dependencies[i], this, nullptr};
+            }
+            depends_on = std::span(links, dependencies.size());
         }
 
+        threadpool_task(const std::initializer_list<threadpool_task*> dependencies) : threadpool_task(std::span(dependencies.begin(), dependencies.size())) {}
         threadpool_task() : threadpool_task({}) {}
         virtual ~threadpool_task() = default;
 
         void enqueue();
+
+        ///Enqueues the task and hands ownership of it to the threadpool - release_detached() is called once it completes.
+        ///A detached task must not be awaited, depended on or otherwise touched after this call.
+        void enqueue_detached();
+
+        ///Sets the lane the task is scheduled in. Must be called before the task is enqueued. Defaults to NORMAL.
+        void set_priority(task_priority new_priority);
+        [[nodiscard]] task_priority get_priority() const;
+
+        ///Restricts the task to the main thread - once ready, it's queued for process_main_thread_tasks() instead of the workers.
+        ///Use for work that needs the GL context. Must be called before the task is enqueued.
+        void set_main_thread_affinity(bool main_thread_only);
+        [[nodiscard]] bool has_main_thread_affinity() const;
+
+        ///Drops the task without executing it if the token is cancelled before the task starts. The token must outlive the task.
+        void set_cancellation_token(const cancellation_token* token);
+        [[nodiscard]] const cancellation_token* get_cancellation_token() const;
+
+        ///Queues a function to run once this task completes, with the same priority, affinity and cancellation token. The threadpool owns the continuation.
+        ///May be called before or after the task is enqueued, but not after it has completed and been destroyed.
+        ///The continuation counts as pending on the token until it's released, so task_group::wait() covers continuations of the group's tasks.
+        void then(std::function<void()> continuation);
+
         bool completed() const;
+
+        ///True if the task completed by being dropped because its cancellation token was cancelled.
+        [[nodiscard]] bool was_cancelled() const;
+
+        ///Blocks until the task has completed. Runs the task inline if it is ready and hasn't been enqueued,
+        ///otherwise executes other queued tasks while waiting - safe to call from inside a task.
         void await_completed();
         bool await_timeout(u32 timeout_ms) const;
 
+        ///Returns a completed task to its initial state so it can be enqueued again, keeping its dependencies. Does not allocate.
+        ///No other thread may still be using the task - wait until every task depending on it has completed too.
+        void reset();
+
     protected:
         virtual void execute() = 0;
 
+        ///Disposes of a detached task after it completes. Override to return the task to a pool instead of deleting it.
+        virtual void release_detached()
+        {
+            delete this;
+        }
+
     private:
+        ///FINISHING is held while waiters are woken - the task may only be destroyed once it reaches COMPLETED, so nothing touches it after that store
         enum class execution_state : u8
         {
-            WAITING, RUNNING, COMPLETED
+            WAITING, RUNNING, FINISHING, COMPLETED
+        };
+
+        ///Edge in the task graph. Owned by the successor, and linked into the dependency's intrusive successor list on enqueue
+        struct dependency_link
+        {
+            threadpool_task* dependency;
+            threadpool_task* successor;
+            dependency_link* next;
         };
 
+        ///Marks a successor list as closed - the task has completed and won't count down anything else
+        static dependency_link successors_closed;
+
         friend bool execute_next_task();
-        friend void update_waiting_tasks();
+        friend bool execute_next_main_thread_task();
+        friend class task_graph;
 
-        ///Attempts to execute the task, will fail and return false if the task is already in progress/complete or dependencies are not complete
+        ///Attempts to execute the task, will fail and return false if the task is already in progress/complete. Dependencies must have completed
         bool try_execute_task();
 
+        ///Attempts to execute the task on the calling thread without going through the queues. Fails if the task has been enqueued, as a queue still references it.
+        bool try_execute_inline();
+
+        ///Marks the task completed and counts down every registered successor
+        void complete();
+
+        ///Registers a link to be counted down when this task completes. Returns false (and does not register) if this task has already completed.
+        bool try_add_successor(dependency_link* link);
+
+        ///Counts down pending dependencies, scheduling the task once they reach zero
+        void dependency_completed();
+
         bool dependencies_completed() const;
 
         ///Ready to execute; not already executing or completed?
         bool state_ready() const;
 
         std::atomic<execution_state> state = execution_state::WAITING;
+        task_priority priority = task_priority::NORMAL;
+        bool main_thread_only = false;
+
+        static constexpr u64 INLINE_DEPENDENCY_COUNT = 2;
+
+        ///Must be written ONCE on creation and never again. Points into inline_dependencies, or heap_dependencies for larger sets
+        std::span<dependency_link> depends_on;
+        std::array<dependency_link, INLINE_DEPENDENCY_COUNT> inline_dependencies {};
+        std::unique_ptr<dependency_link[]> heap_dependencies;
+
+        ///Dependencies that have not completed yet, plus one that is held until the task is enqueued
+        std::atomic<u32> pending_dependencies;
+        std::atomic_bool is_enqueued = false;
+        bool is_detached = false;
+
+        const cancellation_token* cancellation = nullptr;
+        bool dropped = false;
+
+        ///When the task was last queued ready to run, for start latency stats. Zero if it never was.
+        u64 ready_time_ns = 0;
+
+        ///Lock-free intrusive list of links to count down when this task completes, or successors_closed once it has
+        std::atomic<dependency_link*> successors = nullptr;
+    };
+
+    ///Task that runs a function. Handy for one-off jobs that don't warrant their own task class.
+    class function_task final : public threadpool_task
+    {
+    public:
+        explicit function_task(std::function<void()> function, const std::initializer_list<threadpool_task*> dependencies = {}) : threadpool_task(dependencies), function(std::move(function)) {}
+
+    protected:
+        void execute() override
+        {
+            function();
+        }
+
+    private:
+        std::function<void()> function;
+    };
+
+    ///Set of tasks that are waited on or cancelled together, e.g. speculative background work that may be abandoned.
+    ///Tasks are enqueued with the group's cancellation token. Add tasks from one thread at a time.
+    class task_group
+    {
+    public:
+        task_group() = default;
+        task_group(const task_group&) = delete;
+        task_group& operator=(const task_group&) = delete;
+
+        ///Waits for any tasks still in the group.
+        ~task_group();
+
+        ///Enqueues a task as part of the group. The task must stay alive until the group has been waited on.
+        void run(threadpool_task* task);
+
+        ///Enqueues a function as part of the group. The group owns the task it creates.
+        void run(std::function<void()> function, task_priority priority = task_priority::NORMAL);
+
+        ///Drops every task in the group that hasn't started yet. Running tasks can check get_cancellation_token() to stop early.
+        void cancel();
+        [[nodiscard]] const cancellation_token* get_cancellation_token() const;
+
+        ///Blocks until every task in the group, and every continuation queued with the group's token, has completed or been dropped,
+        ///executing queued tasks while waiting. Empties the group and clears cancellation, so it can be reused.
+        void wait();
+
+    private:
+        cancellation_token cancellation;
+        std::vector<threadpool_task*> tasks;
+        std::vector<std::unique_ptr<function_task>> owned_tasks;
+    };
+
+    ///Recycles task objects so tasks created every frame don't touch the heap once the pool has warmed up.
+    ///Slots are allocated in blocks and only given back to the system when the pool is destroyed - release every task before then.
+    template <typename task_type, u32 block_size = 256>
+    class threadpool_task_pool
+    {
+    public:
+        threadpool_task_pool() = default;
+        threadpool_task_pool(const threadpool_task_pool&) = delete;
+        threadpool_task_pool& operator=(const threadpool_task_pool&) = delete;
+
+        template <typename... argument_types>
+        [[nodiscard]] task_type* create(argument_types&&... arguments)
+        {
+            pool_lock.lock();
+            if (free_slots == nullptr) allocate_block();
+            task_slot* slot = free_slots;
+            free_slots = slot->next_free;
+            pool_lock.unlock();
 
-        ///Must be written ONCE on creation and never again
-        std::vector<threadpool_task*> depends_on;
+            return new (slot->storage) task_type(std::forward<argument_types>(arguments)...);
+        }
 
-        std::promise<void> completion_promise;
-        std::future<void> completion_future;
+        ///Destroys a task and returns its slot to the pool. The task must be completed, or never have been enqueued.
+        void release(task_type* task)
+        {
+            if (task == nullptr) return;
+            task->~task_type();
+
+            task_slot* slot = reinterpret_cast<task_slot*>(task);
+            pool_lock.lock();
+            slot->next_free = free_slots;
+            free_slots = slot;
+            pool_lock.unlock();
+        }
 
+    private:
+        union task_slot
+        {
+            task_slot* next_free;
+            alignas(task_type) std::byte storage[sizeof(task_type)];
+        };
+
+        void allocate_block()
+        {
+            blocks.push_back(std::make_unique<task_slot[]>(block_size));
+            task_slot* block = blocks.back().get();
+            for (u32 i = 0; i < block_size; i++)
+            {
+                block[i].next_free = free_slots;
+                free_slots = &block[i];
+            }
+        }
+
+        std::mutex pool_lock;
+        task_slot* free_slots = nullptr;
+        std::vector<std::unique_ptr<task_slot[]>> blocks;
     };
+
+    template <typename function>
+    void parallel_for_split(u64 begin, u64 end, u64 grain, const function& func);
+
+    template <typename value_type, typename map_function, typename reduce_function>
+    value_type parallel_reduce_split(u64 begin, u64 end, u64 grain, const value_type& identity, const map_function& map, const reduce_function& reduce);
+
+    ///Task for one half of a split parallel_for range. Lives on the splitting thread's stack, so no allocation is needed per chunk.
+    template <typename function>
+    class parallel_for_task final : public threadpool_task
+    {
+    public:
+        parallel_for_task(const u64 begin, const u64 end, const u64 grain, const function& func) : begin(begin), end(end), grain(grain), func(func) {}
+
+    protected:
+        void execute() override
+        {
+            parallel_for_split(begin, end, grain, func);
+        }
+
+    private:
+        const u64 begin;
+        const u64 end;
+        const u64 grain;
+        const function& func;
+    };
+
+    ///Task for one half of a split parallel_reduce range. Lives on the splitting thread's stack, so no allocation is needed per chunk.
+    template <typename value_type, typename map_function, typename reduce_function>
+    class parallel_reduce_task final : public threadpool_task
+    {
+    public:
+        parallel_reduce_task(const u64 begin, const u64 end, const u64 grain, const value_type& identity, const map_function& map, const reduce_function& reduce)
+            : result(identity), begin(begin), end(end), grain(grain), identity(identity), map(map), reduce(reduce) {}
+
+        value_type result;
+
+    protected:
+        void execute() override
+        {
+            result = parallel_reduce_split(begin, end, grain, identity, map, reduce);
+        }
+
+    private:
+        const u64 begin;
+        const u64 end;
+        const u64 grain;
+        const value_type& identity;
+        const map_function& map;
+        const reduce_function& reduce;
+    };
+
+    ///Picks a grain size that gives each worker (and the calling thread) a few chunks to balance load with
+    inline u64 automatic_grain_size(const u64 count)
+    {
+        constexpr u64 chunks_per_thread = 4;
+        const u64 thread_count = static_cast<u64>(get_threadpool_size()) + 1;
+        const u64 grain = count / (thread_count * chunks_per_thread);
+        return grain > 0 ? grain : 1;
+    }
+
+    template <typename function>
+    void parallel_for_split(const u64 begin, const u64 end, const u64 grain, const function& func)
+    {
+        if (end - begin <= grain)
+        {
+            for (u64 index = begin; index < end; index++) func(index);
+            return;
+        }
+
+        //Offer the upper half to other workers while this thread recurses into the lower half
+        const u64 middle = begin + (end - begin) / 2;
+        parallel_for_task<function> upper_half(middle, end, grain, func);
+        upper_half.enqueue();
+        parallel_for_split(begin, middle, grain, func);
+        upper_half.await_completed(); //Picks the upper half back up if nobody stole it
+    }
+
+    template <typename value_type, typename map_function, typename reduce_function>
+    value_type parallel_reduce_split(const u64 begin, const u64 end, const u64 grain, const value_type& identity, const map_function& map, const reduce_function& reduce)
+    {
+        if (end - begin <= grain)
+        {
+            value_type result = identity;
+            for (u64 index = begin; index < end; index++) result = reduce(result, map(index));
+            return result;
+        }
+
+        const u64 middle = begin + (end - begin) / 2;
+        parallel_reduce_task<value_type, map_function, reduce_function> upper_half(middle, end, grain, identity, map, reduce);
+        upper_half.enqueue();
+        const value_type lower_result = parallel_reduce_split(begin, middle, grain, identity, map, reduce);
+        upper_half.await_completed();
+        return reduce(lower_result, upper_half.result);
+    }
+
+    ///Calls func(index) for every index in [begin, end), splitting the range recursively across the threadpool.
+    ///The calling thread works on the range too, and returns once every index has been processed.
+    ///A grain of 0 picks a chunk size automatically based on the threadpool size.
+    template <typename function>
+    void parallel_for(const u64 begin, const u64 end, const u64 grain, const function& func)
+    {
+        if (end <= begin) return;
+        const u64 chunk_size = grain > 0 ? grain : automatic_grain_size(end - begin);
+        parallel_for_split(begin, end, chunk_size, func);
+    }
+
+    ///Combines map(index) for every index in [begin, end) using reduce(a, b), splitting the range recursively across the threadpool.
+    ///reduce must be associative, and identity must be its identity value (e.g. 0 for addition). Chunks are combined in index order.
+    ///A grain of 0 picks a chunk size automatically based on the threadpool size.
+    template <typename value_type, typename map_function, typename reduce_function>
+    [[nodiscard]] value_type parallel_reduce(const u64 begin, const u64 end, const u64 grain, const value_type& identity, const map_function& map, const reduce_function& reduce)
+    {
+        if (end <= begin) return identity;
+        const u64 chunk_size = grain > 0 ? grain : automatic_grain_size(end - begin);
+        return parallel_reduce_split(begin, end, chunk_size, identity, map, reduce);
+    }
 }
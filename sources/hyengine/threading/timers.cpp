@@ -0,0 +1,364 @@
+#include "timers.hpp"
+
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <tracy/Tracy.hpp>
+
+#include "../core/logger.hpp"
+
+namespace hyengine
+{
+    //Hashed timer wheel - each timer sits in the slot for its deadline tick modulo the slot count, and timers further out than one
+    //revolution are skipped until their deadline comes round. Timers are stored in a slot map so handles can be cancelled in O(1).
+    //Each slot tracks its earliest deadline and whether it's occupied, so finding the next deadline costs the slot count, not the timer count.
+    static constexpr u32 TIMER_WHEEL_SLOTS = 512;
+    static constexpr u32 NO_TIMER = UINT32_MAX;
+    static constexpr u64 NO_DEADLINE = UINT64_MAX;
+
+    static std::mutex timers_lock;
+
+    ///Runs a timer's function. Each timer keeps one, and resets and enqueues it again every time it fires, so firing doesn't allocate.
+    class timer_task final : public threadpool_task
+    {
+    public:
+        timer_task(std::function<void()> function, const task_priority priority) : function(std::move(function))
+        {
+            set_priority(priority);
+        }
+
+        ///Handed to the threadpool and not released yet. Guarded by timers_lock.
+        bool in_flight = false;
+
+        ///The timer was freed while the task was in flight, so the task deletes itself once released. Guarded by timers_lock.
+        bool retired = false;
+
+    protected:
+        void execute() override
+        {
+            function();
+        }
+
+        void release_detached() override
+        {
+            timers_lock.lock();
+            const bool delete_task = retired;
+            in_flight = false;
+            timers_lock.unlock();
+
+            if (delete_task) delete this;
+        }
+
+    private:
+        std::function<void()> function;
+    };
+
+    struct timer_entry
+    {
+        timer_task* task = nullptr;
+        u64 deadline_tick = 0;
+        u64 interval_ticks = 0; //Zero for one-shot timers
+
+        u32 generation = 1; //Bumped whenever the entry is freed, so stale handles can't cancel a reused entry
+        bool scheduled = false;
+
+        //Intrusive links in the wheel slot list
+        u32 previous = NO_TIMER;
+        u32 next = NO_TIMER;
+    };
+
+    static std::condition_variable timers_condition;
+    static std::vector<timer_entry> timer_entries;
+    static std::vector<u32> free_timer_entries;
+    static std::array<u32, TIMER_WHEEL_SLOTS> wheel_slots = [] {
+        std::array<u32, TIMER_WHEEL_SLOTS> slots {};
+        slots.fill(NO_TIMER);
+        return slots;
+    }();
+
+    //A slot's earliest deadline can be too early after a timer is cancelled, which only costs a spurious wake. It's recomputed whenever
+    //the wheel passes the slot.
+    static std::array<u64, TIMER_WHEEL_SLOTS> slot_earliest_deadlines = [] {
+        std::array<u64, TIMER_WHEEL_SLOTS> deadlines {};
+        deadlines.fill(NO_DEADLINE);
+        return deadlines;
+    }();
+    static std::array<u64, TIMER_WHEEL_SLOTS / 64> occupied_slots {};
+
+    static u64 current_tick = 0;
+    static f64 timer_tick_time = 0.001;
+    static std::chrono::steady_clock::duration tick_duration;
+    static std::chrono::steady_clock::time_point tick_origin; //When tick zero was, had the timers been running all along
+    static std::thread timer_thread;
+    static bool timers_running = false;
+    static bool should_timers_exit = false;
+
+    //The timer thread sleeps until wake_tick. Scheduling an earlier timer lowers it and flags the thread to wake and sleep again.
+    static u64 wake_tick = NO_DEADLINE;
+    static bool timers_rescheduled = false;
+
+    timer_id make_timer_id(const u32 index, const u32 generation)
+    {
+        return static_cast<u64>(generation) << 32 | index;
+    }
+
+    void link_timer(const u32 index)
+    {
+        timer_entry& entry = timer_entries[index];
+        const u64 slot = entry.deadline_tick % TIMER_WHEEL_SLOTS;
+        u32& head = wheel_slots[slot];
+        entry.previous = NO_TIMER;
+        entry.next = head;
+        if (head != NO_TIMER) timer_entries[head].previous = index;
+        head = index;
+
+        slot_earliest_deadlines[slot] = std::min(slot_earliest_deadlines[slot], entry.deadline_tick);
+        occupied_slots[slot / 64] |= 1ULL << slot % 64;
+    }
+
+    void unlink_timer(const u32 index)
+    {
+        const timer_entry& entry = timer_entries[index];
+        const u64 slot = entry.deadline_tick % TIMER_WHEEL_SLOTS;
+        if (entry.previous != NO_TIMER) timer_entries[entry.previous].next = entry.next;
+        else wheel_slots[slot] = entry.next;
+        if (entry.next != NO_TIMER) timer_entries[entry.next].previous = entry.previous;
+
+        if (wheel_slots[slot] == NO_TIMER)
+        {
+            slot_earliest_deadlines[slot] = NO_DEADLINE;
+            occupied_slots[slot / 64] &= ~(1ULL << slot % 64);
+        }
+    }
+
+    void free_timer(const u32 index)
+    {
+        timer_entry& entry = timer_entries[index];
+        if (entry.task->in_flight) entry.task->retired = true;
+        else delete entry.task;
+        entry.task = nullptr;
+        entry.scheduled = false;
+        entry.generation++;
+        free_timer_entries.push_back(index);
+    }
+
+    u64 seconds_to_ticks(const f64 seconds)
+    {
+        return std::max(static_cast<u64>(std::ceil(seconds / timer_tick_time)), static_cast<u64>(1));
+    }
+
+    ///Tick the wheel is due to be at. Time stands still while the timer thread isn't running. Must hold the timers lock.
+    u64 tick_now()
+    {
+        if (!timers_running) return current_tick;
+        return std::max(current_tick, static_cast<u64>((std::chrono::steady_clock::now() - tick_origin) / tick_duration));
+    }
+
+    ///Earliest deadline of any scheduled timer (or a little earlier, see slot_earliest_deadlines), or NO_DEADLINE if there are none.
+    ///Must hold the timers lock.
+    u64 earliest_deadline_tick()
+    {
+        u64 earliest = NO_DEADLINE;
+        for (u32 word = 0; word < occupied_slots.size(); word++)
+        {
+            for (u64 bits = occupied_slots[word]; bits != 0; bits &= bits - 1)
+            {
+                earliest = std::min(earliest, slot_earliest_deadlines[word * 64 + std::countr_zero(bits)]);
+            }
+        }
+        return earliest;
+    }
+
+    timer_id schedule_timer(std::function<void()> function, const f64 delay, const f64 interval, const task_priority priority)
+    {
+        timer_task* task = new timer_task(std::move(function), priority);
+        timers_lock.lock();
+
+        u32 index;
+        if (free_timer_entries.empty())
+        {
+            index = static_cast<u32>(timer_entries.size());
+            timer_entries.emplace_back();
+        }
+        else
+        {
+            index = free_timer_entries.back();
+            free_timer_entries.pop_back();
+        }
+
+        timer_entry& entry = timer_entries[index];
+        entry.task = task;
+        entry.deadline_tick = tick_now() + seconds_to_ticks(delay);
+        entry.interval_ticks = interval > 0 ? seconds_to_ticks(interval) : 0;
+        entry.scheduled = true;
+        link_timer(index);
+
+        const bool wake_timer_thread = entry.deadline_tick < wake_tick;
+        if (wake_timer_thread)
+        {
+            wake_tick = entry.deadline_tick;
+            timers_rescheduled = true;
+        }
+
+        const timer_id id = make_timer_id(index, entry.generation);
+        timers_lock.unlock();
+
+        if (wake_timer_thread) timers_condition.notify_all();
+        return id;
+    }
+
+    timer_id schedule_delayed(std::function<void()> function, const f64 delay, const task_priority priority)
+    {
+        return schedule_timer(std::move(function), delay, 0, priority);
+    }
+
+    timer_id schedule_repeating(std::function<void()> function, const f64 interval, const task_priority priority)
+    {
+        return schedule_timer(std::move(function), interval, interval, priority);
+    }
+
+    bool cancel_timer(const timer_id timer)
+    {
+        const u32 index = static_cast<u32>(timer);
+        const u32 generation = static_cast<u32>(timer >> 32);
+
+        timers_lock.lock();
+        const bool is_scheduled = index < timer_entries.size() && timer_entries[index].generation == generation && timer_entries[index].scheduled;
+        if (is_scheduled)
+        {
+            unlink_timer(index);
+            free_timer(index);
+        }
+        timers_lock.unlock();
+
+        return is_scheduled;
+    }
+
+    ///Advances the wheel one tick, collecting the task of every timer that is due. Must hold the timers lock.
+    void advance_tick(std::vector<timer_task*>& fired)
+    {
+        current_tick++;
+        const u64 slot = current_tick % TIMER_WHEEL_SLOTS;
+        u32 index = wheel_slots[slot];
+
+        //Rebuilt from the timers left in the slot, plus any relinked into it
+        slot_earliest_deadlines[slot] = NO_DEADLINE;
+        while (index != NO_TIMER)
+        {
+            timer_entry& entry = timer_entries[index];
+            const u32 next = entry.next;
+
+            if (entry.deadline_tick > current_tick) slot_earliest_deadlines[slot] = std::min(slot_earliest_deadlines[slot], entry.deadline_tick);
+            else
+            {
+                unlink_timer(index);
+
+                //A repeating timer still running from its last firing skips this one rather than overlapping it
+                if (!entry.task->in_flight)
+                {
+                    entry.task->reset();
+                    entry.task->in_flight = true;
+                    fired.push_back(entry.task);
+                }
+
+                if (entry.interval_ticks > 0)
+                {
+                    //When catching up, skip the firings that were missed, so the next deadline is still ahead of the wheel.
+                    //Relinking behind the wheel would leave the timer waiting a whole revolution.
+                    entry.deadline_tick += entry.interval_ticks;
+                    if (entry.deadline_tick <= current_tick) entry.deadline_tick += ((current_tick - entry.deadline_tick) / entry.interval_ticks + 1) * entry.interval_ticks;
+                    link_timer(index);
+                }
+                else free_timer(index);
+            }
+
+            index = next;
+        }
+    }
+
+    void timer_loop()
+    {
+        set_current_thread_name(" Timers ");
+        log_debug(logger_tags::ASYNC, "Thread entering timer loop");
+
+        std::vector<timer_task*> fired;
+        std::unique_lock lock(timers_lock);
+        while (true)
+        {
+            //Sleep until the earliest deadline, or until something is scheduled if the wheel is empty - an idle wheel never wakes up
+            wake_tick = earliest_deadline_tick();
+            timers_rescheduled = false;
+            const auto woken = [] { return should_timers_exit || timers_rescheduled; };
+            if (wake_tick == NO_DEADLINE) timers_condition.wait(lock, woken);
+            else timers_condition.wait_until(lock, tick_origin + tick_duration * wake_tick, woken);
+
+            //Nothing can be due before wake_tick, so skip the idle ticks leading up to it rather than stepping through them
+            const u64 now_tick = tick_now();
+            if (wake_tick > current_tick + 1) current_tick = std::min(now_tick, wake_tick - 1);
+            if (should_timers_exit) break;
+
+            //Catch up on every tick that has passed, in case this thread was descheduled for a while
+            while (current_tick < now_tick)
+            {
+                advance_tick(fired);
+            }
+
+            if (fired.empty()) continue;
+
+            lock.unlock(); //Don't hold up scheduling while handing work to the threadpool
+            {
+                ZoneScopedN("Fire timers");
+                for (timer_task* task : fired)
+                {
+                    task->enqueue_detached();
+                }
+                fired.clear();
+            }
+            lock.lock();
+        }
+
+        log_debug(logger_tags::ASYNC, "Thread exiting timer loop");
+    }
+
+    void start_timers(const f64 tick_time)
+    {
+        timers_lock.lock();
+        if (timer_thread.joinable())
+        {
+            log_warn(logger_tags::ASYNC, "Not starting timers - timer thread is already running.");
+            timers_lock.unlock();
+            return;
+        }
+
+        if (!(tick_time > 0))
+        {
+            log_error(logger_tags::ASYNC, "Timer tick time must be above zero, not ", tick_time, " - using 0.001 seconds");
+        }
+        timer_tick_time = tick_time > 0 ? tick_time : 0.001;
+        tick_duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<f64>(timer_tick_time));
+        tick_origin = std::chrono::steady_clock::now() - tick_duration * current_tick; //Carry on counting from where the timers were stopped
+        timers_running = true;
+        should_timers_exit = false;
+        timer_thread = std::thread(timer_loop);
+        timers_lock.unlock();
+    }
+
+    void stop_timers()
+    {
+        timers_lock.lock();
+        should_timers_exit = true;
+        timers_lock.unlock();
+        timers_condition.notify_all();
+
+        if (timer_thread.joinable()) timer_thread.join();
+
+        timers_lock.lock();
+        timers_running = false;
+        timers_lock.unlock();
+    }
+}
@@ -0,0 +1,26 @@
+#pragma once
+#include <functional>
+
+#include "threading.hpp"
+
+namespace hyengine
+{
+    ///Identifies a scheduled timer. Stays safe to cancel after the timer has fired or been cancelled.
+    typedef u64 timer_id;
+    constexpr timer_id INVALID_TIMER = 0;
+
+    ///Runs a function on the threadpool once, after a delay in seconds. Fires within one timer tick of the deadline.
+    timer_id schedule_delayed(std::function<void()> function, f64 delay, task_priority priority = task_priority::NORMAL);
+
+    ///Runs a function on the threadpool every interval seconds until cancelled. Deadlines don't drift, but a firing is skipped if the last run hasn't finished.
+    timer_id schedule_repeating(std::function<void()> function, f64 interval, task_priority priority = task_priority::NORMAL);
+
+    ///Stops a timer from firing again. A firing that has already been handed to the threadpool still runs. Returns false if the timer wasn't scheduled.
+    bool cancel_timer(timer_id timer);
+
+    ///Starts the thread that advances the timer wheel in steps of tick_time seconds, sleeping until the next deadline. Called by create_threadpool().
+    void start_timers(f64 tick_time);
+
+    ///Stops the timer thread. Timers stay scheduled, and resume counting down if the timers are started again. Called by release_threadpool().
+    void stop_timers();
+}